@@ -0,0 +1,85 @@
+#include "pch.h"
+
+#include "core/events/event.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+// Emits per second of an Event with 1, 8 and 64 handlers, from 1 up to N emitting threads at once, plus
+// the same with a writer connecting and disconnecting a handler in a loop. Usage: event_bench [max threads]
+
+namespace
+{
+    thread_local uint64_t t_sink = 0;
+
+    constexpr auto DURATION = std::chrono::milliseconds(300);
+
+    // Total emits per second over all emitters
+    double run(Event<int>& event, size_t emitters, bool churn)
+    {
+        std::atomic<bool> start = false;
+        std::atomic<bool> stop = false;
+        std::atomic<uint64_t> total = 0;
+
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < emitters; ++i)
+        {
+            threads.emplace_back([&]
+            {
+                while (!start) std::this_thread::yield();
+
+                uint64_t emits = 0;
+                for (; !stop.load(std::memory_order_relaxed); ++emits) event(static_cast<int>(emits));
+                total += emits;
+            });
+        }
+
+        if (churn)
+        {
+            threads.emplace_back([&]
+            {
+                while (!start) std::this_thread::yield();
+                while (!stop.load(std::memory_order_relaxed))
+                {
+                    auto connection = event.connect([](int value) { t_sink += static_cast<uint64_t>(value); });
+                    connection.disconnect();
+                }
+            });
+        }
+
+        const auto begin = std::chrono::steady_clock::now();
+        start = true;
+        std::this_thread::sleep_for(DURATION);
+        stop = true;
+        for (auto& thread : threads) thread.join();
+
+        const auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        return static_cast<double>(total) / seconds;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const size_t maxEmitters = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 8;
+
+    std::printf("%u hardware threads\n", std::thread::hardware_concurrency());
+    for (const size_t handlers : {1, 8, 64})
+    {
+        Event<int> event;
+        std::vector<Event<int>::Connection> connections;
+        for (size_t i = 0; i < handlers; ++i)
+            connections.push_back(event.connect([](int value) { t_sink += static_cast<uint64_t>(value); }));
+
+        std::printf("%zu handlers\n", handlers);
+        for (size_t emitters = 1; emitters <= maxEmitters; emitters *= 2)
+        {
+            const auto steady = run(event, emitters, false);
+            const auto churn = run(event, emitters, true);
+            std::printf("  %2zu emitters %10.2f M emits/s, with connect/disconnect churn %10.2f M emits/s\n",
+                        emitters, steady / 1e6, churn / 1e6);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,86 @@
+#include "pch.h"
+
+#include "memory/hook_manager.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+// Calls per second through a hooked function whose detour reaches the original the way CALL_ORIGINAL did
+// before OriginalSlot (HookManager::getOriginal, a locked lookup in the detour-to-original map) and the way
+// it does now (one load of the detour's slot). "original only" calls the trampoline without a detour, the
+// floor both paths are measured against. Usage: original_slot_bench [millions of calls]
+
+#define NOINLINE __attribute__((noinline))
+
+namespace
+{
+    volatile int g_calls = 0;
+    volatile int g_sink = 0;
+
+    NOINLINE int mapTarget(int a, int b)
+    {
+        g_calls = g_calls + 1;
+        return a ^ b;
+    }
+
+    NOINLINE int slotTarget(int a, int b)
+    {
+        g_calls = g_calls + 1;
+        return a ^ b;
+    }
+
+    NOINLINE int mapDetour(int a, int b)
+    {
+        return HookManager::getInstance().getOriginal(&mapDetour)(a, b);
+    }
+
+    NOINLINE int slotDetour(int a, int b)
+    {
+        return CALL_ORIGINAL(slotDetour, a, b);
+    }
+
+    // Called through a volatile pointer, the hooked code is the one that runs
+    template <typename T>
+    T opaque(T function)
+    {
+        volatile T pointer = function;
+        return pointer;
+    }
+
+    void run(const char* name, int (*function)(int, int), size_t calls)
+    {
+        constexpr int REPEATS = 3;
+
+        double best = 0.0;
+        for (int i = 0; i < REPEATS; ++i)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            int sink = 0;
+            for (size_t j = 0; j < calls; ++j) sink += function(static_cast<int>(j), 3);
+            g_sink = sink;
+            const auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            best = (std::max)(best, static_cast<double>(calls) / seconds);
+        }
+        std::printf("  %-20s %8.1f M calls/s %8.2f ns/call\n", name, best / 1e6, 1e9 / best);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const size_t calls = (argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 50) * 1'000'000;
+
+    if (!HookManager::install(&mapTarget, &mapDetour) || !HookManager::install(&slotTarget, &slotDetour))
+    {
+        std::printf("failed to install the hooks\n");
+        return 1;
+    }
+
+    std::printf("%zu M calls, hook backend %s\n", calls / 1'000'000, HookManager::getInstance().getBackendName());
+    run("original only", opaque(HookManager::getInstance().getOriginal(&slotDetour)), calls);
+    run("getOriginal (map)", opaque(&mapTarget), calls);
+    run("CALL_ORIGINAL (slot)", opaque(&slotTarget), calls);
+
+    HookManager::getInstance().shutdown();
+    return 0;
+}
@@ -0,0 +1,138 @@
+#include "pch.h"
+
+#include "memory/scanner.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+// Scan throughput of Scanner's backends against the byte-by-byte loop Mem::patternScan used before, over
+// synthetic 50-200 MB buffers with a match planted near the end. Usage: scanner_bench [megabytes...]
+
+namespace
+{
+    constexpr auto PATTERN = "48 8B 05 ? ? ? ? 48 85 C0 74 ? E8";
+    constexpr uint8_t MATCH[] = {0x48, 0x8B, 0x05, 0x10, 0x20, 0x30, 0x00, 0x48, 0x85, 0xC0, 0x74, 0x08, 0xE8};
+
+    // Bytes drawn with roughly the frequencies of x64 code, so the anchor pre-filter sees realistic hit rates
+    std::vector<uint8_t> makeBuffer(size_t size)
+    {
+        constexpr uint8_t common[] = {0x00, 0x00, 0x00, 0x48, 0x48, 0x8B, 0x89, 0xFF, 0xCC, 0xE8, 0x0F, 0x24,
+                                      0x85, 0xC0, 0x4C, 0x8D, 0x83, 0x74, 0x01, 0x44};
+
+        std::vector<uint8_t> buffer(size);
+        std::mt19937_64 random(42);
+        for (size_t i = 0; i < size; i += 8)
+        {
+            auto value = random();
+            for (size_t j = 0; j < 8 && i + j < size; ++j, value >>= 8)
+            {
+                const auto byte = static_cast<uint8_t>(value);
+                buffer[i + j] = byte < 160 ? common[byte % std::size(common)] : byte;
+            }
+        }
+
+        memcpy(buffer.data() + size - sizeof(MATCH) - 64, MATCH, sizeof(MATCH));
+        return buffer;
+    }
+
+    // Mem::patternScan before the SIMD scanner: the pattern as ints, -1 for wildcards
+    const uint8_t* legacyScan(const uint8_t* begin, size_t size, const char* signature)
+    {
+        std::vector<int> pattern;
+        const auto end = const_cast<char*>(signature) + strlen(signature);
+        for (auto current = const_cast<char*>(signature); current < end; ++current)
+        {
+            if (*current == '?')
+            {
+                ++current;
+                if (*current == '?' && current < end) ++current;
+                pattern.push_back(-1);
+            }
+            else
+            {
+                pattern.push_back(static_cast<int>(strtoul(current, &current, 16)));
+            }
+        }
+
+        const auto s = pattern.size();
+        const auto d = pattern.data();
+        for (size_t i = 0; i < size - s; ++i)
+        {
+            bool found = true;
+            for (size_t j = 0; j < s; ++j)
+            {
+                if (begin[i + j] != d[j] && d[j] != -1)
+                {
+                    found = false;
+                    break;
+                }
+            }
+            if (found) return begin + i;
+        }
+        return nullptr;
+    }
+
+    template <typename Fn>
+    void run(const char* name, size_t size, const uint8_t* expected, Fn&& scan)
+    {
+        constexpr int REPEATS = 3;
+
+        double best = 0.0;
+        for (int i = 0; i < REPEATS; ++i)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            const auto result = scan();
+            const auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            if (result != expected)
+            {
+                std::printf("  %-16s wrong result\n", name);
+                std::exit(1);
+            }
+            best = (std::max)(best, static_cast<double>(size) / seconds / 1e9);
+        }
+        std::printf("  %-16s %8.2f GB/s\n", name, best);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<size_t> sizes;
+    for (int i = 1; i < argc; ++i) sizes.push_back(std::strtoull(argv[i], nullptr, 10));
+    if (sizes.empty()) sizes = {50, 100, 200};
+
+    const Signature signature(PATTERN);
+    constexpr auto staticSignature = "48 8B 05 ? ? ? ? 48 85 C0 74 ? E8"_sig;
+    const auto avx2 = Scanner::bestBackend() == Scanner::Backend::AVX2;
+
+    for (const auto megabytes : sizes)
+    {
+        const auto buffer = makeBuffer(megabytes << 20);
+        const auto begin = buffer.data();
+        const auto end = begin + buffer.size();
+        const auto expected = legacyScan(begin, buffer.size(), PATTERN);
+
+        std::printf("%zu MB, pattern \"%s\"\n", megabytes, PATTERN);
+        run("legacy", buffer.size(), expected, [&] { return legacyScan(begin, buffer.size(), PATTERN); });
+        run("scalar", buffer.size(), expected, [&]
+        {
+            return Scanner::find(begin, end, signature, Scanner::Backend::Scalar);
+        });
+        run("sse2", buffer.size(), expected, [&]
+        {
+            return Scanner::find(begin, end, signature, Scanner::Backend::SSE2);
+        });
+        if (avx2)
+        {
+            run("avx2", buffer.size(), expected, [&]
+            {
+                return Scanner::find(begin, end, signature, Scanner::Backend::AVX2);
+            });
+        }
+        run("static _sig", buffer.size(), expected, [&] { return Scanner::find(begin, end, staticSignature); });
+        run("parallel", buffer.size(), expected, [&] { return Scanner::findParallel({{begin, end}}, signature); });
+    }
+    return 0;
+}
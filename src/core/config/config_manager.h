@@ -66,6 +66,7 @@ public:
     void resetAll();
 
     std::string getConfigFilePath() const { return getConfigPath(); }
+    std::filesystem::path getConfigDirectoryPath() const { return getConfigDirectory(); }
     bool isDirty() const { return m_isDirty.load(); }
     const nlohmann::json& data() const { return m_data; }
 
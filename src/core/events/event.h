@@ -1,5 +1,7 @@
 ﻿#pragma once
 
+#include "utils/rcu_snapshot.h"
+
 template <typename... Args>
 class EventConnection
 {
@@ -66,41 +68,13 @@ public:
 private:
     struct HandlerSlot
     {
-        std::shared_ptr<Handler> handler;
-        std::atomic<bool> active{true};
+        std::shared_ptr<const Handler> handler;
         size_t id;
-
-        HandlerSlot(Handler h, size_t slot_id)
-            : handler(std::make_shared<Handler>(std::move(h)))
-            , id(slot_id)
-        {
-        }
-
-        // Disable copy, enable move
-        HandlerSlot(const HandlerSlot&) = delete;
-        HandlerSlot& operator=(const HandlerSlot&) = delete;
-
-        HandlerSlot(HandlerSlot&& other) noexcept
-            : handler(std::move(other.handler))
-            , active(other.active.load())
-            , id(other.id)
-        {
-        }
-
-        HandlerSlot& operator=(HandlerSlot&& other) noexcept
-        {
-            if (this != &other)
-            {
-                handler = std::move(other.handler);
-                active.store(other.active.load());
-                id = other.id;
-            }
-            return *this;
-        }
     };
 
-    mutable std::mutex m_mutex;
-    std::vector<HandlerSlot> m_handlers;
+    // Emitting reads the current array without a lock, allocation or refcount change. connect and
+    // disconnect publish a modified copy, handlers themselves are shared between the copies.
+    RcuSnapshot<std::vector<HandlerSlot>> m_handlers;
     std::atomic<size_t> m_nextId{1};
 
 public:
@@ -118,13 +92,14 @@ public:
         static_assert(std::is_invocable_v<Callable, Args...>,
                       "Callable must be invocable with the event's argument types");
 
-        std::lock_guard lock(m_mutex);
-
         size_t id = m_nextId++;
 
         // Convert callable to std::function
-        Handler handler = std::forward<Callable>(callable);
-        m_handlers.emplace_back(std::move(handler), id);
+        auto handler = std::make_shared<const Handler>(std::forward<Callable>(callable));
+        m_handlers.update([&](std::vector<HandlerSlot>& handlers)
+        {
+            handlers.push_back({std::move(handler), id});
+        });
 
         // Return connection that can disconnect this specific handler
         return Connection([this, id]
@@ -171,28 +146,14 @@ public:
     template <typename... UArgs>
     void operator()(UArgs&&... args)
     {
-        // Create a copy of active handlers to avoid holding lock during execution
-        std::vector<std::shared_ptr<Handler>> activeHandlers;
-
-        {
-            std::lock_guard lock(m_mutex);
-            activeHandlers.reserve(m_handlers.size());
-
-            for (const auto& slot : m_handlers)
-            {
-                if (slot.active.load())
-                {
-                    activeHandlers.push_back(slot.handler);
-                }
-            }
-        }
+        // The snapshot stays alive until the guard is gone, handlers may connect or disconnect meanwhile
+        const auto handlers = m_handlers.read();
 
-        // Execute handlers without holding the lock
-        for (const auto& handler : activeHandlers)
+        for (const auto& slot : *handlers)
         {
             try
             {
-                (*handler)(std::forward<UArgs>(args)...);
+                (*slot.handler)(std::forward<UArgs>(args)...);
             }
             catch (const std::exception& e)
             {
@@ -207,34 +168,21 @@ public:
 
     void clear()
     {
-        std::lock_guard lock(m_mutex);
-        for (auto& slot : m_handlers)
-        {
-            slot.active.store(false);
-        }
-        m_handlers.clear();
+        m_handlers.update([](std::vector<HandlerSlot>& handlers) { handlers.clear(); });
     }
 
     _NODISCARD bool empty() const
     {
-        std::lock_guard lock(m_mutex);
-        return m_handlers.empty();
+        return m_handlers.read()->empty();
     }
 
 private:
     void disconnectHandler(size_t id)
     {
-        std::lock_guard lock(m_mutex);
-
-        for (auto it = m_handlers.begin(); it != m_handlers.end(); ++it)
+        m_handlers.update([id](std::vector<HandlerSlot>& handlers)
         {
-            if (it->id == id)
-            {
-                it->active.store(false);
-                m_handlers.erase(it);
-                break;
-            }
-        }
+            std::erase_if(handlers, [id](const HandlerSlot& slot) { return slot.id == id; });
+        });
     }
 };
 
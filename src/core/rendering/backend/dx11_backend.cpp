@@ -130,8 +130,8 @@ bool DX11Backend::setupHooks()
     auto& hookManager = HookManager::getInstance();
 
     bool success = true;
-    success &= HookManager::install(presentAddr, hookedPresent);
-    success &= HookManager::install(resizeBuffersAddr, hookedResizeBuffers);
+    success &= HookManager::install<hookedPresent>(presentAddr);
+    success &= HookManager::install<hookedResizeBuffers>(resizeBuffersAddr);
 
     return success;
 }
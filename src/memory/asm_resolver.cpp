@@ -1,169 +1,184 @@
 ﻿#include "pch.h"
 #include "asm_resolver.h"
 
-uintptr_t AsmResolver::relativeJMP() const
+#include "virtual_memory.h"
+#include "x64_decoder.h"
+
+std::shared_mutex AsmResolver::m_followMutex;
+std::unordered_map<uintptr_t, uintptr_t> AsmResolver::m_followCache;
+
+namespace
 {
-    auto code = reinterpret_cast<BYTE*>(m_address);
-    if (code[0] != 0xE9) return m_address;
-    return m_address + *reinterpret_cast<int32_t*>(&code[1]) + 5;
+    using Instruction = X64Decoder::Instruction;
+
+    // mov r/m, r / mov r, r/m / mov r/m, imm / movsxd and movzx/movsx
+    bool isMov(const Instruction& instruction)
+    {
+        const auto opcode = instruction.opcode;
+        if (instruction.vex) return false;
+        if (instruction.map == 0)
+            return (opcode >= 0x88 && opcode <= 0x8B) || opcode == 0xC6 || opcode == 0xC7 || opcode == 0x63;
+        if (instruction.map == 1) return opcode == 0xB6 || opcode == 0xB7 || opcode == 0xBE || opcode == 0xBF;
+        return false;
+    }
+
+    // SSE (legacy 0F, 0F 38, 0F 3A maps) and every VEX/EVEX instruction
+    bool isSimd(const Instruction& instruction)
+    {
+        if (instruction.vex) return true;
+
+        const auto opcode = instruction.opcode;
+        switch (instruction.map)
+        {
+        case 1:
+            return (opcode >= 0x10 && opcode <= 0x17) || (opcode >= 0x28 && opcode <= 0x2F) ||
+                (opcode >= 0x50 && opcode <= 0x7F) || opcode == 0xC2 || (opcode >= 0xC4 && opcode <= 0xC6) ||
+                opcode >= 0xD0;
+        case 2:
+            return opcode < 0xF0; // F0-FF are movbe/crc32 and friends
+        case 3:
+            return true;
+        default:
+            return false;
+        }
+    }
 }
 
-uintptr_t AsmResolver::relativeCALL() const
+bool AsmResolver::decode(X64Decoder::Instruction& instruction) const
 {
-    auto code = reinterpret_cast<BYTE*>(m_address);
-    if (code[0] != 0xE8) return m_address;
-    return m_address + *reinterpret_cast<int32_t*>(&code[1]) + 5;
+    return X64Decoder::decode(reinterpret_cast<const uint8_t*>(m_address), X64Decoder::MAX_LENGTH, instruction);
 }
 
-uintptr_t AsmResolver::relativeMOV() const
+size_t AsmResolver::length() const
 {
-    auto code = reinterpret_cast<BYTE*>(m_address);
-    // for (int i = 0; i < 7; i++)
-    // {
-    // 	LOG_DEBUG("Byte[{}]: 0x{:02X}", i, code[i]);
-    // }
+    Instruction instruction;
+    return decode(instruction) ? instruction.length : 0;
+}
 
-    int offset = 0;
+uintptr_t AsmResolver::next() const
+{
+    return m_address + length();
+}
 
-    bool hasREX = code[0] >= 0x40 && code[0] <= 0x4F;
-    if (hasREX) offset++;
+uintptr_t AsmResolver::relative() const
+{
+    return resolve([](const Instruction&) { return true; });
+}
 
-    // Check MOV load
-    if (code[offset] != 0x8B && code[offset] != 0x89) return m_address;
-    offset++;
+uintptr_t AsmResolver::relativeJMP() const
+{
+    return resolve([](const Instruction& instruction)
+    {
+        return instruction.map == 0 && (instruction.opcode == 0xE9 || instruction.opcode == 0xEB);
+    });
+}
 
-    // Check ModR/M for RIP relative addressing
-    BYTE modrm = code[offset];
-    if ((modrm & 0xC7) != 0x05) return m_address;
-    offset++;
+uintptr_t AsmResolver::relativeCALL() const
+{
+    return resolve([](const Instruction& instruction) { return instruction.map == 0 && instruction.opcode == 0xE8; });
+}
 
-    int32_t displacement = *reinterpret_cast<int32_t*>(&code[offset]);
-    return m_address + displacement + offset + 4;
+uintptr_t AsmResolver::relativeMOV() const
+{
+    return resolve([](const Instruction& instruction) { return instruction.ripRelative && isMov(instruction); });
 }
 
 uintptr_t AsmResolver::relativeLEA() const
 {
-    auto code = reinterpret_cast<BYTE*>(m_address);
-    int offset = 0;
-
-    bool hasREX = code[0] >= 0x40 && code[0] <= 0x4F;
-    if (hasREX) offset++;
+    return resolve([](const Instruction& instruction)
+    {
+        return instruction.ripRelative && instruction.map == 0 && instruction.opcode == 0x8D;
+    });
+}
 
-    // Check LEA opcode
-    if (code[offset] != 0x8D) return m_address;
-    offset++;
+uintptr_t AsmResolver::relativeSIMD() const
+{
+    return resolve([](const Instruction& instruction) { return instruction.ripRelative && isSimd(instruction); });
+}
 
-    // Check ModR/M for RIP relative addressing
-    BYTE modrm = code[offset];
-    if ((modrm & 0xC7) != 0x05) return m_address;
-    offset++;
+uintptr_t AsmResolver::resolve(bool (*accept)(const X64Decoder::Instruction&)) const
+{
+    Instruction instruction;
+    if (!decode(instruction) || !accept(instruction)) return m_address;
 
-    int32_t displacement = *reinterpret_cast<int32_t*>(&code[offset]);
-    return m_address + displacement + offset + 4;
+    const auto target = X64Decoder::target(reinterpret_cast<const uint8_t*>(m_address), instruction, m_address);
+    return target ? target : m_address;
 }
 
-uintptr_t AsmResolver::relativeSIMD() const
+uintptr_t AsmResolver::follow() const
 {
-    auto code = reinterpret_cast<BYTE*>(m_address);
-    int offset = 0;
-
-    // Skip legacy prefixes
-    while (offset < 4 && (code[offset] == 0x66 || code[offset] == 0xF2 || code[offset] == 0xF3))
     {
-        offset++;
+        std::shared_lock lock(m_followMutex);
+        if (const auto it = m_followCache.find(m_address); it != m_followCache.end()) return it->second;
     }
 
-    // Check for optional REX prefix
-    if (code[offset] >= 0x40 && code[offset] <= 0x4F)
+    std::vector<uintptr_t> chain{m_address};
+    for (size_t depth = 0; depth < MAX_FOLLOW_DEPTH; ++depth)
     {
-        offset++;
+        const auto next = followStep(chain.back(), depth == 0);
+        if (!next || std::ranges::find(chain, next) != chain.end()) break;
+        chain.push_back(next);
     }
 
-    // Must have 0x0F prefix for SSE/AVX instructions
-    if (code[offset] != 0x0F) return m_address;
-    offset++;
-
-    // Check for common SSE/AVX opcodes with memory operands
-    BYTE opcode = code[offset];
-    bool validOpcode = (
-        opcode == 0x10 || opcode == 0x11 || // MOVUPS/MOVUPD
-        opcode == 0x28 || opcode == 0x29 || // MOVAPS/MOVAPD
-        opcode == 0x6F || opcode == 0x7F || // MOVDQU/MOVDQA
-        opcode == 0x2E || opcode == 0x2F || // UCOMISS/COMISS
-        opcode == 0x51 || opcode == 0x52 || // SQRTPS/RSQRTPS
-        opcode == 0x58 || opcode == 0x59 || // ADDPS/MULPS
-        opcode == 0x5C || opcode == 0x5D || // SUBPS/MINPS
-        opcode == 0x5E || opcode == 0x5F // DIVPS/MAXPS
-    );
-
-    if (!validOpcode) return m_address;
-    offset++;
-
-    // Check ModR/M for RIP relative addressing (mod=00, r/m=101)
-    BYTE modrm = code[offset];
-    if ((modrm & 0xC7) != 0x05) return m_address;
-    offset++;
-
-    int32_t displacement = *reinterpret_cast<int32_t*>(&code[offset]);
-    return m_address + displacement + offset + 4;
+    // Every hop of the chain resolves to the same function body
+    const auto target = chain.back();
+    std::unique_lock lock(m_followMutex);
+    for (const auto hop : chain) m_followCache[hop] = target;
+    return target;
 }
 
-uintptr_t AsmResolver::JMP() const
+std::optional<FunctionIndex::Function> AsmResolver::function() const
 {
-    uintptr_t addr = relativeJMP();
-    if (m_module == 0) return addr;
-    if (addr >= m_module)
-    {
-        uintptr_t rva = addr - m_module;
-        return m_module + rva;
-    }
-    return addr;
+    const auto index = m_module ? &FunctionIndex::forModule(m_module) : FunctionIndex::forAddress(m_address);
+    return index ? index->find(m_address) : std::nullopt;
 }
 
-uintptr_t AsmResolver::CALL() const
+void AsmResolver::clearFollowCache()
 {
-    uintptr_t addr = relativeCALL();
-    if (m_module == 0) return addr;
-    if (addr >= m_module)
-    {
-        uintptr_t rva = addr - m_module;
-        return m_module + rva;
-    }
-    return addr;
+    std::unique_lock lock(m_followMutex);
+    m_followCache.clear();
 }
 
-uintptr_t AsmResolver::MOV() const
+void AsmResolver::clearFollowCache(uintptr_t begin, uintptr_t end)
 {
-    uintptr_t addr = relativeMOV();
-    if (m_module == 0) return addr;
-    if (addr >= m_module)
-    {
-        uintptr_t rva = addr - m_module;
-        return m_module + rva;
-    }
-    return addr;
-}
+    const auto inside = [begin, end](uintptr_t address) { return address >= begin && address < end; };
 
-uintptr_t AsmResolver::LEA() const
-{
-    uintptr_t addr = relativeLEA();
-    if (m_module == 0) return addr;
-    if (addr >= m_module)
-    {
-        uintptr_t rva = addr - m_module;
-        return m_module + rva;
-    }
-    return addr;
+    std::unique_lock lock(m_followMutex);
+    std::erase_if(m_followCache, [&inside](const auto& entry) { return inside(entry.first) || inside(entry.second); });
 }
 
-uintptr_t AsmResolver::SIMD() const
+uintptr_t AsmResolver::followStep(uintptr_t address, bool allowCall)
 {
-    uintptr_t addr = relativeSIMD();
-    if (m_module == 0) return addr;
-    if (addr >= m_module)
+    // Destinations come from jump displacements and import slots, so they can point anywhere
+    if (!VirtualMemory::isReadable(address, X64Decoder::MAX_LENGTH)) return 0;
+
+    const auto code = reinterpret_cast<const uint8_t*>(address);
+
+    Instruction instruction;
+    if (!X64Decoder::decode(code, X64Decoder::MAX_LENGTH, instruction) || instruction.map != 0) return 0;
+
+    switch (instruction.opcode)
+    {
+    case 0xE8:
+        if (!allowCall) return 0;
+        [[fallthrough]];
+    case 0xE9:
+    case 0xEB:
+        return X64Decoder::target(code, instruction, address);
+    case 0xFF:
     {
-        uintptr_t rva = addr - m_module;
-        return m_module + rva;
+        // FF /4 is jmp r/m64, FF /2 call r/m64; only [rip+x] forms are thunks
+        const auto reg = (instruction.modrm >> 3) & 7;
+        if (!instruction.ripRelative || !(reg == 4 || (allowCall && reg == 2))) return 0;
+
+        const auto slot = X64Decoder::target(code, instruction, address);
+        if (!VirtualMemory::isReadable(slot, sizeof(uintptr_t))) return 0;
+
+        uintptr_t destination;
+        memcpy(&destination, reinterpret_cast<const void*>(slot), sizeof(destination));
+        return destination;
+    }
+    default:
+        return 0;
     }
-    return addr;
 }
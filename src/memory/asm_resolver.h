@@ -1,5 +1,13 @@
 ﻿#pragma once
 
+#include "function_index.h"
+#include "x64_decoder.h"
+
+#include <shared_mutex>
+#include <unordered_map>
+
+// Resolves the address an instruction refers to. All decoding is done by X64Decoder, the relativeXXX()
+// helpers only check the instruction kind and return the input address if it does not match.
 class AsmResolver
 {
 public:
@@ -15,21 +23,59 @@ public:
     {
     }
 
+    uintptr_t getModule() const { return m_module; }
     uintptr_t getAddress() const { return m_address; }
 
+    bool decode(X64Decoder::Instruction& instruction) const;
+
+    // Length of the instruction, 0 if it can't be decoded
+    size_t length() const;
+
+    // Address of the following instruction
+    uintptr_t next() const;
+
+    // Target of any [rip + disp32] operand or relative branch (cmp, test, movzx, VEX...)
+    uintptr_t relative() const;
+
     uintptr_t relativeJMP() const;
     uintptr_t relativeCALL() const;
     uintptr_t relativeMOV() const;
     uintptr_t relativeLEA() const;
     uintptr_t relativeSIMD() const;
 
-    uintptr_t JMP() const;
-    uintptr_t CALL() const;
-    uintptr_t MOV() const;
-    uintptr_t LEA() const;
-    uintptr_t SIMD() const;
+    uintptr_t JMP() const { return relativeJMP(); }
+    uintptr_t CALL() const { return relativeCALL(); }
+    uintptr_t MOV() const { return relativeMOV(); }
+    uintptr_t LEA() const { return relativeLEA(); }
+    uintptr_t SIMD() const { return relativeSIMD(); }
+
+    // Follows a chain of thunks to the function body: jmp rel8/rel32 and jmp [rip+x] (import stubs,
+    // incremental link tables), plus call rel32 / call [rip+x] when the chain starts at a call site.
+    // Stops after MAX_FOLLOW_DEPTH hops, or at a hop whose code isn't readable. Results are cached
+    // process-wide by address, since thunks never move; see clearFollowCache for unloaded images.
+    uintptr_t follow() const;
+
+    // Function containing the address. Uses the module passed to the constructor when there is one (a
+    // PeFile base works too), otherwise the loaded module the address lies in.
+    std::optional<FunctionIndex::Function> function() const;
+
+    // Drops cached follow() results, e.g. after an import slot was rewritten
+    static void clearFollowCache();
+
+    // Drops the cached chains starting or ending in [begin, end), for a module or PeFile going away
+    static void clearFollowCache(uintptr_t begin, uintptr_t end);
+
+    static constexpr size_t MAX_FOLLOW_DEPTH = 8;
 
 private:
+    uintptr_t resolve(bool (*accept)(const X64Decoder::Instruction&)) const;
+
+    // Destination of the thunk at 'address', 0 if the instruction is not a jump
+    static uintptr_t followStep(uintptr_t address, bool allowCall);
+
     uintptr_t m_module;
     uintptr_t m_address;
+
+    static std::shared_mutex m_followMutex;
+    static std::unordered_map<uintptr_t, uintptr_t> m_followCache;
 };
@@ -0,0 +1,102 @@
+﻿#include "pch.h"
+#include "closure_thunk.h"
+
+#include "nearby_arena.h"
+#include "virtual_memory.h"
+
+#include <cstring>
+
+namespace
+{
+#ifdef _WIN32
+    constexpr uint8_t SEGMENT_PREFIX = 0x65; // gs
+    constexpr uint32_t TEB_TLS_SLOTS = 0x1480;
+
+    // Offset of our TLS slot from gs, 0 if none could be allocated
+    uint32_t contextOffset()
+    {
+        static const uint32_t offset = []() -> uint32_t
+        {
+            // Only the first TLS_MINIMUM_AVAILABLE slots live directly in the TEB
+            const auto index = TlsAlloc();
+            if (index == TLS_OUT_OF_INDEXES || index >= TLS_MINIMUM_AVAILABLE)
+            {
+                LOG_ERROR("No TEB TLS slot available for closure thunks");
+                return 0;
+            }
+            return TEB_TLS_SLOTS + index * static_cast<uint32_t>(sizeof(void*));
+        }();
+        return offset;
+    }
+#else
+    constexpr uint8_t SEGMENT_PREFIX = 0x64; // fs
+
+    // Initial-exec keeps the variable in static TLS, at the same fs offset on every thread
+    __attribute__((tls_model("initial-exec"))) thread_local void* t_context = nullptr;
+
+    uint32_t contextOffset()
+    {
+        static const uint32_t offset = []
+        {
+            // fs:0 holds the thread control block's own address on x86-64
+            uintptr_t threadPointer;
+            asm("mov %%fs:0, %0" : "=r"(threadPointer));
+            return static_cast<uint32_t>(reinterpret_cast<uintptr_t>(&t_context) - threadPointer);
+        }();
+        return offset;
+    }
+#endif
+}
+
+void* ClosureThunk::create(const void* context, const void* invoker, uintptr_t near)
+{
+    const auto offset = contextOffset();
+    if (!offset) return nullptr;
+
+    const auto origin = near ? near : reinterpret_cast<uintptr_t>(invoker);
+    const auto thunk = static_cast<uint8_t*>(NearbyArena::getInstance().allocate(origin, SIZE));
+    if (!thunk) return nullptr;
+
+    const auto contextValue = reinterpret_cast<uint64_t>(context);
+    const auto invokerValue = reinterpret_cast<uint64_t>(invoker);
+
+    uint8_t code[SIZE];
+    memset(code, 0xCC, sizeof(code));
+
+    code[0] = 0x48; // mov rax, imm64
+    code[1] = 0xB8;
+    memcpy(code + 2, &contextValue, sizeof(contextValue));
+
+    code[10] = SEGMENT_PREFIX; // mov seg:[disp32], rax
+    code[11] = 0x48;
+    code[12] = 0x89;
+    code[13] = 0x04;
+    code[14] = 0x25;
+    memcpy(code + 15, &offset, sizeof(offset));
+
+    code[19] = 0x48; // mov rax, imm64
+    code[20] = 0xB8;
+    memcpy(code + 21, &invokerValue, sizeof(invokerValue));
+
+    code[29] = 0xFF; // jmp rax
+    code[30] = 0xE0;
+
+    // Arena memory is already writable and executable, nothing runs this thunk yet
+    memcpy(thunk, code, sizeof(code));
+    VirtualMemory::flushInstructionCache(reinterpret_cast<uintptr_t>(thunk), SIZE);
+    return thunk;
+}
+
+void ClosureThunk::destroy(void* thunk)
+{
+    if (thunk) NearbyArena::getInstance().free(thunk);
+}
+
+void* ClosureThunk::currentContext()
+{
+#ifdef _WIN32
+    return reinterpret_cast<void*>(__readgsqword(contextOffset()));
+#else
+    return t_context;
+#endif
+}
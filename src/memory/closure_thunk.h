@@ -0,0 +1,26 @@
+﻿#pragma once
+
+#include <cstdint>
+
+// Executable stubs that let a closure act as a plain function pointer. A thunk stores its context pointer
+// in a per-thread slot (a TEB TLS slot through gs on Windows, a static TLS variable through fs on Linux)
+// and jumps to a shared invoker, which reads the slot back with currentContext() before doing anything
+// else. Arguments and the stack are left untouched, so any signature works.
+//
+//   mov rax, context
+//   mov gs:[slot], rax
+//   mov rax, invoker
+//   jmp rax
+class ClosureThunk
+{
+public:
+    // Thunk taken from the NearbyArena close to 'near' (0 for anywhere), nullptr on failure
+    static void* create(const void* context, const void* invoker, uintptr_t near = 0);
+    static void destroy(void* thunk);
+
+    // Context of the thunk that entered the running invoker. Must be read before the invoker calls
+    // anything that could go through another thunk.
+    static void* currentContext();
+
+    static constexpr size_t SIZE = 32;
+};
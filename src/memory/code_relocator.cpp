@@ -0,0 +1,202 @@
+﻿#include "pch.h"
+#include "code_relocator.h"
+
+#include "x64_decoder.h"
+
+#include <cstring>
+
+namespace
+{
+    bool fitsRel32(int64_t value)
+    {
+        return value >= INT32_MIN && value <= INT32_MAX;
+    }
+
+    void appendRel32(std::vector<uint8_t>& code, int64_t value)
+    {
+        const auto rel = static_cast<int32_t>(value);
+        const auto bytes = reinterpret_cast<const uint8_t*>(&rel);
+        code.insert(code.end(), bytes, bytes + sizeof(rel));
+    }
+
+    void appendAddress(std::vector<uint8_t>& code, uintptr_t address)
+    {
+        const auto bytes = reinterpret_cast<const uint8_t*>(&address);
+        code.insert(code.end(), bytes, bytes + sizeof(address));
+    }
+
+    // ret, retf, jmp rel/r/m/far, int3 and ud2: execution never continues with the next byte
+    bool isTerminator(const X64Decoder::Instruction& instruction)
+    {
+        const auto opcode = instruction.opcode;
+        if (instruction.vex) return false;
+        if (instruction.map == 1) return opcode == 0x0B;
+        if (instruction.map != 0) return false;
+
+        switch (opcode)
+        {
+        case 0xC2:
+        case 0xC3:
+        case 0xCA:
+        case 0xCB:
+        case 0xCC:
+        case 0xE9:
+        case 0xEA:
+        case 0xEB:
+            return true;
+        case 0xFF:
+        {
+            const auto reg = (instruction.modrm >> 3) & 7;
+            return reg == 4 || reg == 5;
+        }
+        default:
+            return false;
+        }
+    }
+}
+
+void CodeRelocator::appendJump(std::vector<uint8_t>& code, uintptr_t destination)
+{
+    code.insert(code.end(), {0xFF, 0x25, 0x00, 0x00, 0x00, 0x00});
+    appendAddress(code, destination);
+}
+
+std::optional<CodeRelocator::Result> CodeRelocator::relocate(uintptr_t source, size_t minLength,
+                                                             uintptr_t destination)
+{
+    Result result;
+
+    // Decode first, the branch checks need the full extent of the copied range
+    std::vector<X64Decoder::Instruction> instructions;
+    while (result.sourceLength < minLength)
+    {
+        X64Decoder::Instruction instruction;
+        const auto code = reinterpret_cast<const uint8_t*>(source + result.sourceLength);
+        if (!X64Decoder::decode(code, X64Decoder::MAX_LENGTH, instruction))
+        {
+            LOG_ERROR("Can't decode instruction at {:#x}", source + result.sourceLength);
+            return std::nullopt;
+        }
+
+        instructions.push_back(instruction);
+        result.sourceLength += instruction.length;
+
+        if (isTerminator(instruction))
+        {
+            result.fallsThrough = false;
+            break;
+        }
+    }
+
+    // A short function: the jump may only cover the padding after its last instruction
+    if (!result.fallsThrough && result.sourceLength < minLength)
+    {
+        const auto padding = reinterpret_cast<const uint8_t*>(source);
+        for (auto offset = result.sourceLength; offset < minLength; ++offset)
+        {
+            if (padding[offset] != 0xCC && padding[offset] != 0x90)
+            {
+                LOG_ERROR("Function at {:#x} ends after {} bytes, too short to hook", source, result.sourceLength);
+                return std::nullopt;
+            }
+        }
+    }
+
+    auto address = source;
+    for (const auto& instruction : instructions)
+    {
+        const auto code = reinterpret_cast<const uint8_t*>(address);
+        const auto next = address + instruction.length;
+        const auto here = destination + result.code.size();
+        const auto target = X64Decoder::target(code, instruction, address);
+
+        if (instruction.relative)
+        {
+            // Inside the range the destination is only reachable through the copy, but other code could
+            // still jump to the original bytes in between
+            if (target > source && target < source + result.sourceLength)
+            {
+                LOG_ERROR("Branch at {:#x} targets the relocated range", address);
+                return std::nullopt;
+            }
+
+            const auto opcode = instruction.opcode;
+            const bool oneByte = instruction.map == 0;
+
+            if (oneByte && opcode == 0xE8) // call rel32
+            {
+                if (fitsRel32(static_cast<int64_t>(target - (here + 5))))
+                {
+                    result.code.push_back(0xE8);
+                    appendRel32(result.code, static_cast<int64_t>(target - (here + 5)));
+                }
+                else
+                {
+                    // call [rip+2]; jmp +8; dq target
+                    result.code.insert(result.code.end(), {0xFF, 0x15, 0x02, 0x00, 0x00, 0x00, 0xEB, 0x08});
+                    appendAddress(result.code, target);
+                }
+            }
+            else if (oneByte && (opcode == 0xE9 || opcode == 0xEB)) // jmp rel32 / rel8
+            {
+                if (fitsRel32(static_cast<int64_t>(target - (here + 5))))
+                {
+                    result.code.push_back(0xE9);
+                    appendRel32(result.code, static_cast<int64_t>(target - (here + 5)));
+                }
+                else
+                {
+                    appendJump(result.code, target);
+                }
+            }
+            else if ((oneByte && opcode >= 0x70 && opcode <= 0x7F) || (instruction.map == 1 && opcode >= 0x80 &&
+                opcode <= 0x8F)) // jcc rel8 / rel32
+            {
+                const auto condition = static_cast<uint8_t>(opcode & 0x0F);
+                if (fitsRel32(static_cast<int64_t>(target - (here + 6))))
+                {
+                    result.code.insert(result.code.end(), {0x0F, static_cast<uint8_t>(0x80 | condition)});
+                    appendRel32(result.code, static_cast<int64_t>(target - (here + 6)));
+                }
+                else
+                {
+                    // Inverted jcc over an absolute jump
+                    result.code.insert(result.code.end(), {static_cast<uint8_t>(0x70 | (condition ^ 1)),
+                                                           static_cast<uint8_t>(ABSOLUTE_JUMP_SIZE)});
+                    appendJump(result.code, target);
+                }
+            }
+            else
+            {
+                // loop/jrcxz only have a rel8 form
+                LOG_ERROR("Can't relocate branch {:#x} at {:#x}", opcode, address);
+                return std::nullopt;
+            }
+        }
+        else if (instruction.ripRelative)
+        {
+            const auto offset = result.code.size();
+            result.code.insert(result.code.end(), code, code + instruction.length);
+
+            const auto displacement = static_cast<int64_t>(target - (here + instruction.length));
+            if (!fitsRel32(displacement))
+            {
+                LOG_ERROR("RIP-relative operand at {:#x} is out of reach from {:#x}", address, here);
+                return std::nullopt;
+            }
+
+            const auto rel = static_cast<int32_t>(displacement);
+            memcpy(result.code.data() + offset + instruction.dispOffset, &rel, sizeof(rel));
+        }
+        else
+        {
+            result.code.insert(result.code.end(), code, code + instruction.length);
+        }
+
+        address = next;
+    }
+
+    // The padding is overwritten, but never executed
+    result.sourceLength = (std::max)(result.sourceLength, minLength);
+    return result;
+}
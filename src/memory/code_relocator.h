@@ -0,0 +1,34 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+// Moves whole instructions to a new address, as needed for the bytes displaced by a hook jump.
+// [rip + disp32] operands get a new displacement, relative jmp/call/jcc keep their destination
+// (as rel32 when it is in reach, otherwise through an absolute jump). loop/jrcxz and branches into the
+// copied range itself are rejected. Copying stops at an instruction that doesn't fall through (ret, jmp,
+// int3, ud2); bytes still needed after it are taken only if they are 0xCC or 0x90 padding, anything else
+// may be the start of another function and the site is rejected.
+class CodeRelocator
+{
+public:
+    struct Result
+    {
+        std::vector<uint8_t> code; // the instructions as they have to be written at 'destination'
+        size_t sourceLength = 0;   // bytes taken from 'source', whole instructions, >= minLength
+        bool fallsThrough = true;  // false if the copy ends in ret/jmp/int3 and needs no jump back
+    };
+
+    static std::optional<Result> relocate(uintptr_t source, size_t minLength, uintptr_t destination);
+
+    // Upper bound for the relocated size when covering 'minLength' bytes: an instruction grows to at most
+    // 16 bytes (call or jcc through an absolute jump) and at most 'minLength' instructions are copied
+    static constexpr size_t maxSize(size_t minLength) { return minLength * 16; }
+
+    // Size of the absolute jump appended by appendJump
+    static constexpr size_t ABSOLUTE_JUMP_SIZE = 14;
+
+    // jmp [rip+0] followed by the 8 byte destination
+    static void appendJump(std::vector<uint8_t>& code, uintptr_t destination);
+};
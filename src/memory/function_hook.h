@@ -1,7 +1,12 @@
 ﻿#pragma once
 
+#include "closure_thunk.h"
 #include "hook_manager.h"
 
+#include <cstddef>
+#include <new>
+#include <type_traits>
+
 template <typename Signature>
 class FunctionHook;
 
@@ -17,6 +22,22 @@ public:
     {
     }
 
+    // Nothing to remove once HookManager has shut down, which at exit may already have been destroyed, but the
+    // closure and its thunk are ours either way
+    ~FunctionHook()
+    {
+        if (m_handle && m_handle->installed) remove();
+
+        dropRollback();
+        releaseClosure();
+    }
+
+    // The thunk and the rollback callback point at this object, so it has to stay where it is
+    FunctionHook(const FunctionHook&) = delete;
+    FunctionHook& operator=(const FunctionHook&) = delete;
+    FunctionHook(FunctionHook&&) = delete;
+    FunctionHook& operator=(FunctionHook&&) = delete;
+
     void target(FunctionPtr target)
     {
         if (!m_isHooked && !m_targetSet)
@@ -26,6 +47,7 @@ public:
         }
     }
 
+    // Joins the open HookManager batch if there is one, the hook is then live once the batch is committed
     bool set(FunctionPtr detour)
     {
         if (m_isHooked || !m_targetSet || !m_targetFn) return false;
@@ -37,16 +59,71 @@ public:
         if (success)
         {
             m_isHooked = true;
-            m_originalFn = HookManager::getInstance().getOriginal(detour);
+            m_originalFn = reinterpret_cast<void*>(HookManager::getInstance().getOriginal(detour));
+            m_handle = HookManager::getInstance().findHook(reinterpret_cast<void*>(m_targetFn));
+
+            // The hook is removed again by then, so nothing can still be running in the closure's thunk. The
+            // batch may outlive this object (removed or destroyed before it closes), hence the guard.
+            m_rollbackGuard = std::make_shared<bool>(true);
+            HookManager::onBatchRollback([this, alive = m_rollbackGuard]
+            {
+                if (!*alive) return;
+
+                m_rollbackGuard = nullptr;
+                m_isHooked = false;
+                m_originalFn = nullptr;
+                m_detourFn = nullptr;
+                m_handle = nullptr;
+                releaseClosure();
+            });
         }
 
         return success;
     }
 
-    // TODO: Support lambda hooks later
-    // bool set() 
-    // {
-    // }
+    // Any callable with the hooked signature as the detour (capturing lambda, functor...). It is stored
+    // inside the hook and reached through a ClosureThunk, so a call involves no allocation and no lookup.
+    // Use call() from inside it to run the original.
+    template <typename Callable>
+        requires (std::is_invocable_r_v<ReturnType, std::decay_t<Callable>&, Args...> &&
+            !std::is_convertible_v<Callable, FunctionPtr>)
+    bool set(Callable&& callable)
+    {
+        using Closure = std::decay_t<Callable>;
+        static_assert(sizeof(Closure) <= CLOSURE_SIZE && alignof(Closure) <= alignof(std::max_align_t),
+                      "Detour closure does not fit in FunctionHook, capture a pointer to the state instead");
+
+        if (m_isHooked || !m_targetSet || !m_targetFn) return false;
+
+        releaseClosure();
+
+        const auto thunk = ClosureThunk::create(this, reinterpret_cast<const void*>(&invokeClosure),
+                                                reinterpret_cast<uintptr_t>(m_targetFn));
+        if (!thunk) return false;
+
+        new (m_closure) Closure(std::forward<Callable>(callable));
+        m_closureCall = [](void* closure, Args... args) -> ReturnType
+        {
+            return (*static_cast<Closure*>(closure))(std::forward<Args>(args)...);
+        };
+        m_closureDestroy = [](void* closure) { static_cast<Closure*>(closure)->~Closure(); };
+        m_thunk = thunk;
+
+        if (set(reinterpret_cast<FunctionPtr>(thunk))) return true;
+
+        releaseClosure();
+        return false;
+    }
+
+    // Member function of 'object' as the detour
+    template <typename Class>
+    bool set(ReturnType (Class::*method)(Args...), Class* object)
+    {
+        return set([object, method](Args... args) -> ReturnType
+        {
+            return (object->*method)(std::forward<Args>(args)...);
+        });
+    }
 
     ReturnType call(Args... args) const
     {
@@ -88,18 +165,22 @@ public:
             m_isHooked = false;
             m_originalFn = nullptr;
             m_detourFn = nullptr;
+            m_handle = nullptr;
+            dropRollback();
+            releaseClosure();
         }
     }
 
+    // Toggles an installed hook without removing it, joins the open HookManager batch if there is one
     void enable(const bool enabled = true)
     {
-        if (!m_targetFn) return;
+        if (!m_isHooked || !m_targetFn) return;
 
-        if (enabled && !m_isHooked)
+        if (enabled)
         {
             HookManager::getInstance().enableHook(reinterpret_cast<void*>(m_targetFn));
         }
-        else if (!enabled && m_isHooked)
+        else
         {
             HookManager::getInstance().disableHook(reinterpret_cast<void*>(m_targetFn));
         }
@@ -108,12 +189,52 @@ public:
     void disable() { enable(false); }
 
     _NODISCARD bool isActive() const { return m_isHooked; }
+
+    // Installed and currently jumping to the detour
+    _NODISCARD bool isEnabled() const
+    {
+        return m_isHooked && HookManager::getInstance().isEnabled(reinterpret_cast<void*>(m_targetFn));
+    }
     _NODISCARD bool hasTarget() const { return m_targetSet && m_targetFn != nullptr; }
 
+    static constexpr size_t CLOSURE_SIZE = 64;
+
 private:
+    // Entered from the thunk, which published the owning hook as the context
+    static ReturnType invokeClosure(Args... args)
+    {
+        const auto self = static_cast<FunctionHook*>(ClosureThunk::currentContext());
+        return self->m_closureCall(self->m_closure, std::forward<Args>(args)...);
+    }
+
+    // The rollback callback registered by set() no longer touches this object
+    void dropRollback()
+    {
+        if (m_rollbackGuard) *m_rollbackGuard = false;
+        m_rollbackGuard = nullptr;
+    }
+
+    void releaseClosure()
+    {
+        if (m_closureDestroy) m_closureDestroy(m_closure);
+        ClosureThunk::destroy(m_thunk);
+
+        m_closureCall = nullptr;
+        m_closureDestroy = nullptr;
+        m_thunk = nullptr;
+    }
+
     FunctionPtr m_targetFn = nullptr;
     void* m_detourFn = nullptr;
     void* m_originalFn = nullptr;
     bool m_isHooked = false;
     bool m_targetSet = false;
+    HookManager::HookHandle m_handle;
+    std::shared_ptr<bool> m_rollbackGuard;
+
+    // Closure detour, see set(Callable)
+    alignas(std::max_align_t) unsigned char m_closure[CLOSURE_SIZE];
+    ReturnType (*m_closureCall)(void* closure, Args... args) = nullptr;
+    void (*m_closureDestroy)(void* closure) = nullptr;
+    void* m_thunk = nullptr;
 };
@@ -0,0 +1,128 @@
+﻿#include "pch.h"
+#include "function_index.h"
+
+std::shared_mutex FunctionIndex::m_cacheMutex;
+std::unordered_map<uintptr_t, std::unique_ptr<FunctionIndex>> FunctionIndex::m_cache;
+
+FunctionIndex::FunctionIndex(uintptr_t module)
+    : m_module(module)
+{
+    const PeImage image(module);
+    if (!image.valid()) return;
+
+    m_size = image.sizeOfImage();
+
+    const auto exception = image.directory(pe::DIRECTORY_EXCEPTION);
+    if (!exception.virtualAddress || !inImage(exception.virtualAddress, exception.size))
+    {
+        LOG_WARN("Module {:#x} has no exception directory", module);
+        return;
+    }
+
+    m_entries = {
+        reinterpret_cast<const pe::RuntimeFunction*>(module + exception.virtualAddress),
+        exception.size / sizeof(pe::RuntimeFunction)
+    };
+
+    // The loader relies on the table being sorted, but a hand-built or damaged image might not be
+    if (!std::ranges::is_sorted(m_entries, {}, &pe::RuntimeFunction::beginAddress))
+    {
+        LOG_WARN("Exception directory of {:#x} is not sorted", module);
+        m_sorted.assign(m_entries.begin(), m_entries.end());
+        std::ranges::sort(m_sorted, {}, &pe::RuntimeFunction::beginAddress);
+        m_entries = m_sorted;
+    }
+
+    m_valid = true;
+}
+
+const FunctionIndex& FunctionIndex::forModule(uintptr_t module)
+{
+    {
+        std::shared_lock lock(m_cacheMutex);
+        if (const auto it = m_cache.find(module); it != m_cache.end()) return *it->second;
+    }
+
+    std::unique_lock lock(m_cacheMutex);
+    auto& index = m_cache[module];
+    if (!index) index = std::make_unique<FunctionIndex>(module);
+    return *index;
+}
+
+const FunctionIndex* FunctionIndex::forAddress(uintptr_t address)
+{
+#ifdef _WIN32
+    HMODULE module = nullptr;
+    if (!GetModuleHandleExW(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,
+                            reinterpret_cast<LPCWSTR>(address), &module))
+        return nullptr;
+
+    return &forModule(reinterpret_cast<uintptr_t>(module));
+#else
+    (void)address;
+    return nullptr;
+#endif
+}
+
+void FunctionIndex::release(uintptr_t module)
+{
+    std::unique_lock lock(m_cacheMutex);
+    m_cache.erase(module);
+}
+
+std::optional<FunctionIndex::Function> FunctionIndex::find(uintptr_t address) const
+{
+    if (!m_valid || address < m_module || address - m_module >= m_size) return std::nullopt;
+
+    const auto rva = static_cast<uint32_t>(address - m_module);
+    const auto it = std::ranges::upper_bound(m_entries, rva, {}, &pe::RuntimeFunction::beginAddress);
+    if (it == m_entries.begin()) return std::nullopt;
+
+    const auto& part = *std::prev(it);
+    if (rva >= part.endAddress) return std::nullopt;
+
+    const auto primary = primaryOf(&part);
+    return Function{
+        m_module + primary->beginAddress,
+        m_module + primary->endAddress,
+        m_module + primary->unwindInfoAddress,
+        m_module + part.beginAddress,
+        m_module + part.endAddress
+    };
+}
+
+uintptr_t FunctionIndex::functionStart(uintptr_t address) const
+{
+    const auto function = find(address);
+    return function ? function->begin : 0;
+}
+
+const pe::RuntimeFunction* FunctionIndex::primaryOf(const pe::RuntimeFunction* entry) const
+{
+    for (size_t depth = 0; depth < MAX_CHAIN_DEPTH; ++depth)
+    {
+        auto unwind = entry->unwindInfoAddress;
+
+        // Some linkers share unwind data by pointing at another RUNTIME_FUNCTION, tagged with the low bit
+        if (unwind & 1)
+        {
+            unwind &= ~1u;
+            if (!inImage(unwind, sizeof(pe::RuntimeFunction))) break;
+            entry = reinterpret_cast<const pe::RuntimeFunction*>(m_module + unwind);
+            continue;
+        }
+
+        if (!inImage(unwind, sizeof(pe::UnwindInfo))) break;
+
+        const auto info = reinterpret_cast<const pe::UnwindInfo*>(m_module + unwind);
+        if (!((info->versionAndFlags >> 3) & pe::UNW_FLAG_CHAININFO)) break;
+
+        const auto chained = unwind + static_cast<uint32_t>(sizeof(pe::UnwindInfo)) +
+            ((info->countOfCodes + 1u) & ~1u) * static_cast<uint32_t>(sizeof(uint16_t));
+        if (!inImage(chained, sizeof(pe::RuntimeFunction))) break;
+
+        entry = reinterpret_cast<const pe::RuntimeFunction*>(m_module + chained);
+    }
+
+    return entry;
+}
@@ -0,0 +1,64 @@
+﻿#pragma once
+
+#include "pe_image.h"
+
+#include <memory>
+#include <optional>
+#include <shared_mutex>
+#include <span>
+#include <unordered_map>
+
+// Function boundaries from the exception directory (.pdata) of an x64 image. Every non-leaf function has
+// a RUNTIME_FUNCTION entry, sorted by start address, so a lookup is a binary search. Parts split off a
+// function (cold blocks, funclets) have their own entry whose unwind info chains back to the parent; those
+// are followed so find() reports the real entry point. Works on loaded modules and PeFile buffers alike.
+class FunctionIndex
+{
+public:
+    struct Function
+    {
+        uintptr_t begin;      // entry point, after following chained unwind info
+        uintptr_t end;        // end of the entry point's part
+        uintptr_t unwindInfo; // UNWIND_INFO of the entry point's part
+        uintptr_t partBegin;  // the .pdata entry actually containing the address, equal to begin/end
+        uintptr_t partEnd;    // unless the address is in a chained part
+    };
+
+    explicit FunctionIndex(uintptr_t module);
+
+    // Shared index of a module, built on first use. Also accepts a PeFile base.
+    static const FunctionIndex& forModule(uintptr_t module);
+
+    // Index of the loaded module containing 'address', nullptr if there is none (always on Linux, use
+    // forModule with an offline image there)
+    static const FunctionIndex* forAddress(uintptr_t address);
+
+    // Drops the shared index of a module, call before unloading it or freeing its PeFile
+    static void release(uintptr_t module);
+
+    _NODISCARD bool valid() const { return m_valid; }
+    _NODISCARD uintptr_t module() const { return m_module; }
+    _NODISCARD size_t size() const { return m_entries.size(); }
+    _NODISCARD std::span<const pe::RuntimeFunction> entries() const { return m_entries; }
+
+    // Function containing 'address', nullopt for leaf functions, padding and non-code addresses
+    _NODISCARD std::optional<Function> find(uintptr_t address) const;
+
+    // Entry point of the function containing 'address', 0 if there is none
+    _NODISCARD uintptr_t functionStart(uintptr_t address) const;
+
+    static constexpr size_t MAX_CHAIN_DEPTH = 32;
+
+private:
+    _NODISCARD const pe::RuntimeFunction* primaryOf(const pe::RuntimeFunction* entry) const;
+    _NODISCARD bool inImage(uint32_t rva, size_t size) const { return rva <= m_size && size <= m_size - rva; }
+
+    uintptr_t m_module;
+    uint32_t m_size = 0;
+    bool m_valid = false;
+    std::span<const pe::RuntimeFunction> m_entries;
+    std::vector<pe::RuntimeFunction> m_sorted; // only used when the table in the image is not sorted
+
+    static std::shared_mutex m_cacheMutex;
+    static std::unordered_map<uintptr_t, std::unique_ptr<FunctionIndex>> m_cache;
+};
@@ -0,0 +1,26 @@
+﻿#pragma once
+
+// What HookManager needs from a hooking library. A hook is created disabled, 'original' receives the
+// trampoline that runs the target's own code. Queued changes are applied together by applyQueued, so a
+// backend that has to stop other threads does so once per batch. Failures are logged by the backend.
+class HookBackend
+{
+public:
+    virtual ~HookBackend() = default;
+
+    _NODISCARD virtual const char* name() const = 0;
+
+    virtual bool initialize() = 0;
+    virtual void uninitialize() = 0;
+
+    virtual bool create(void* target, void* detour, void** original) = 0;
+    virtual bool remove(void* target) = 0;
+
+    virtual bool enable(void* target) = 0;
+    virtual bool disable(void* target) = 0;
+
+    // Hooks already in the queued state are skipped when the queue is applied
+    virtual bool queueEnable(void* target) = 0;
+    virtual bool queueDisable(void* target) = 0;
+    virtual bool applyQueued() = 0;
+};
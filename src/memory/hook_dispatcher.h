@@ -0,0 +1,189 @@
+﻿#pragma once
+
+#include "function_hook.h"
+#include "utils/rcu_snapshot.h"
+
+#include <functional>
+#include <optional>
+#include <unordered_map>
+#include <variant>
+
+template <typename Signature>
+class HookDispatcher;
+
+// One hook per target that fans out to any number of listeners, so several features can intercept the
+// same function without stacking trampolines. Pre listeners run before the original and can skip it or
+// set the return value, post listeners run after it and can replace the return value. Listeners live in
+// an RcuSnapshot: dispatching takes no lock and allocates nothing, and adding or removing a listener
+// never touches the target's code again.
+//
+//   auto& dispatcher = HookDispatcher<void(void*, int)>::get(target);
+//   const auto id = dispatcher.addPre([](auto& context, void*& self, int& index) { ... });
+//   dispatcher.remove(id);
+template <typename ReturnType, typename... Args>
+class HookDispatcher<ReturnType(Args...)>
+{
+public:
+    using FunctionPtr = ReturnType(*)(Args...);
+    using ListenerId = uint64_t;
+
+    class Context
+    {
+    public:
+        void skipOriginal() { m_skipOriginal = true; }
+        _NODISCARD bool isOriginalSkipped() const { return m_skipOriginal; }
+
+        // The value the caller will get, set by the original or a listener
+        template <typename R = ReturnType> requires (!std::is_void_v<R>)
+        void setReturnValue(R value) { m_returnValue = std::move(value); }
+
+        template <typename R = ReturnType> requires (!std::is_void_v<R>)
+        _NODISCARD const std::optional<R>& returnValue() const { return m_returnValue; }
+
+    private:
+        friend class HookDispatcher;
+
+        bool m_skipOriginal = false;
+        std::conditional_t<std::is_void_v<ReturnType>, std::monostate, std::optional<ReturnType>> m_returnValue;
+    };
+
+    // Arguments are passed by reference, pre listeners may change what the original receives
+    using Listener = std::function<void(Context&, Args&...)>;
+
+    // Shared dispatcher of a target, the hook is installed when the first listener is added
+    static HookDispatcher& get(FunctionPtr target);
+
+    // Listeners run by ascending priority, in insertion order within one priority. Returns 0, with nothing
+    // added, if the hook can't be installed.
+    ListenerId addPre(Listener listener, int priority = 0) { return add(std::move(listener), priority, true); }
+    ListenerId addPost(Listener listener, int priority = 0) { return add(std::move(listener), priority, false); }
+    bool remove(ListenerId id);
+
+    _NODISCARD size_t listenerCount() const;
+    _NODISCARD bool isInstalled() const { return m_hook.isActive(); }
+
+    HookDispatcher(const HookDispatcher&) = delete;
+    HookDispatcher& operator=(const HookDispatcher&) = delete;
+
+private:
+    explicit HookDispatcher(FunctionPtr target)
+        : m_target(target)
+        , m_hook(target)
+    {
+    }
+
+    struct Entry
+    {
+        ListenerId id;
+        int priority;
+        Listener listener;
+    };
+
+    struct Listeners
+    {
+        std::vector<Entry> pre;
+        std::vector<Entry> post;
+    };
+
+    ListenerId add(Listener listener, int priority, bool pre);
+    ReturnType dispatch(Args... args);
+
+    FunctionPtr m_target;
+    FunctionHook<ReturnType(Args...)> m_hook;
+    RcuSnapshot<Listeners> m_listeners;
+    std::mutex m_installMutex;
+    std::atomic<ListenerId> m_nextId{1};
+
+    static inline std::mutex s_registryMutex;
+    static inline std::unordered_map<FunctionPtr, std::unique_ptr<HookDispatcher>> s_registry;
+};
+
+template <typename ReturnType, typename... Args>
+HookDispatcher<ReturnType(Args...)>& HookDispatcher<ReturnType(Args...)>::get(FunctionPtr target)
+{
+    std::lock_guard lock(s_registryMutex);
+
+    auto& dispatcher = s_registry[target];
+    if (!dispatcher) dispatcher.reset(new HookDispatcher(target));
+    return *dispatcher;
+}
+
+template <typename ReturnType, typename... Args>
+typename HookDispatcher<ReturnType(Args...)>::ListenerId HookDispatcher<ReturnType(Args...)>::add(
+    Listener listener, int priority, bool pre)
+{
+    // Only the first listener installs the hook, later ones just publish a new snapshot. The hook goes in
+    // before the listener is published, with no listeners a call goes straight to the original.
+    {
+        std::lock_guard lock(m_installMutex);
+        if (!m_hook.isActive() && !m_hook.set([this](Args... args) -> ReturnType
+        {
+            return dispatch(std::forward<Args>(args)...);
+        }))
+        {
+            LOG_ERROR("Failed to install dispatcher hook on {:p}", reinterpret_cast<void*>(m_target));
+            return 0;
+        }
+    }
+
+    const auto id = m_nextId.fetch_add(1, std::memory_order_relaxed);
+    m_listeners.update([&](Listeners& listeners)
+    {
+        auto& list = pre ? listeners.pre : listeners.post;
+        const auto it = std::ranges::upper_bound(list, priority, {}, &Entry::priority);
+        list.insert(it, Entry{id, priority, std::move(listener)});
+    });
+    return id;
+}
+
+template <typename ReturnType, typename... Args>
+bool HookDispatcher<ReturnType(Args...)>::remove(ListenerId id)
+{
+    bool found = false;
+    m_listeners.update([&](Listeners& listeners)
+    {
+        for (auto* list : {&listeners.pre, &listeners.post})
+            found |= std::erase_if(*list, [id](const Entry& entry) { return entry.id == id; }) != 0;
+    });
+
+    // The hook stays in place, with no listeners a call goes straight to the original
+    return found;
+}
+
+template <typename ReturnType, typename... Args>
+size_t HookDispatcher<ReturnType(Args...)>::listenerCount() const
+{
+    const auto listeners = m_listeners.read();
+    return listeners->pre.size() + listeners->post.size();
+}
+
+template <typename ReturnType, typename... Args>
+ReturnType HookDispatcher<ReturnType(Args...)>::dispatch(Args... args)
+{
+    const auto listeners = m_listeners.read();
+    Context context;
+
+    for (const auto& entry : listeners->pre) entry.listener(context, args...);
+
+    if (!context.m_skipOriginal)
+    {
+        if constexpr (std::is_void_v<ReturnType>)
+        {
+            m_hook.call(args...);
+        }
+        else
+        {
+            // A value set by a pre listener wins over the original's
+            auto result = m_hook.call(args...);
+            if (!context.m_returnValue) context.m_returnValue = std::move(result);
+        }
+    }
+
+    for (const auto& entry : listeners->post) entry.listener(context, args...);
+
+    if constexpr (!std::is_void_v<ReturnType>)
+    {
+        if (context.m_returnValue) return std::move(*context.m_returnValue);
+        return ReturnType{};
+    }
+}
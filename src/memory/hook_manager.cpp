@@ -1,6 +1,20 @@
 ﻿#include "pch.h"
 #include "hook_manager.h"
 
+#include "function_index.h"
+
+#ifdef _WIN32
+#include "min_hook_backend.h"
+#else
+#include "inline_hook_backend.h"
+
+#include <dlfcn.h>
+#include <link.h>
+#endif
+
+#include <chrono>
+#include <ranges>
+
 HookManager& HookManager::getInstance()
 {
     static HookManager instance;
@@ -12,125 +26,408 @@ HookManager::~HookManager()
     shutdown();
 }
 
+void HookManager::waitForBatch(std::unique_lock<std::shared_mutex>& lock)
+{
+    m_batchClosed.wait(lock, [this] { return !m_batchOpen || ownsBatch(); });
+}
+
+bool HookManager::ownsBatch() const
+{
+    return m_batchOpen && m_batchOwner == std::this_thread::get_id();
+}
+
+void HookManager::closeBatch()
+{
+    m_batchOpen = false;
+    m_batchOwner = {};
+    m_batchClosed.notify_all();
+}
+
+bool HookManager::inBatch() const
+{
+    std::shared_lock lock(m_mutex);
+    return ownsBatch();
+}
+
 bool HookManager::initialize()
 {
     if (m_initialized) return true;
 
-    auto status = MH_Initialize();
-    if (status != MH_OK) return false;
+    if (!m_backend)
+    {
+#ifdef _WIN32
+        m_backend = std::make_unique<MinHookBackend>();
+#else
+        m_backend = std::make_unique<InlineHookBackend>();
+#endif
+    }
+
+    if (!m_backend->initialize()) return false;
 
     m_initialized = true;
     return true;
 }
 
+bool HookManager::setBackend(std::unique_ptr<HookBackend> backend)
+{
+    auto& instance = getInstance();
+    std::unique_lock lock(instance.m_mutex);
+
+    if (instance.m_initialized)
+    {
+        LOG_ERROR("Can't switch to hook backend {} while {} is in use", backend ? backend->name() : "none",
+                  instance.getBackendName());
+        return false;
+    }
+
+    instance.m_backend = std::move(backend);
+    return true;
+}
+
 void HookManager::shutdown()
 {
+    std::unique_lock lock(m_mutex);
+    waitForBatch(lock);
     if (!m_initialized) return;
 
-    for (auto& hook : m_hooks)
+    for (const auto& hook : m_hooks | std::views::values)
     {
-        if (hook->target)
-        {
-            MH_DisableHook(hook->target);
-            MH_RemoveHook(hook->target);
-        }
+        m_backend->disable(hook->target);
+        m_backend->remove(hook->target);
+        hook->enabled = false;
+        hook->installed = false;
+        setOriginal(hook->detour, nullptr);
     }
 
-    MH_Uninitialize();
+    m_backend->uninitialize();
+
     m_hooks.clear();
-    m_detourToOriginal.clear();
     m_initialized = false;
 }
 
 bool HookManager::uninstall(void* target)
 {
     auto& instance = getInstance();
+    std::unique_lock lock(instance.m_mutex);
+    instance.waitForBatch(lock);
     if (!instance.m_initialized) return false;
 
-    auto it = std::ranges::find_if(instance.m_hooks,
-                                   [target](const std::unique_ptr<HookInfo>& hook)
-                                   {
-                                       return hook->target == target;
-                                   });
-
+    const auto it = instance.m_hooks.find(target);
     if (it == instance.m_hooks.end()) return false;
 
-    auto& hook = *it;
+    const auto& hook = it->second;
+
+    if (hook->enabled && !instance.m_backend->disable(hook->target)) return false;
+    if (!instance.m_backend->remove(hook->target)) return false;
+
+    instance.setOriginal(hook->detour, nullptr);
+    hook->enabled = false;
+    hook->installed = false;
+    instance.m_hooks.erase(it);
+
+    return true;
+}
+
+bool HookManager::enableHook(void* target)
+{
+    std::unique_lock lock(m_mutex);
+    waitForBatch(lock);
+    return setHookEnabled(target, true);
+}
+
+bool HookManager::disableHook(void* target)
+{
+    std::unique_lock lock(m_mutex);
+    waitForBatch(lock);
+    return setHookEnabled(target, false);
+}
 
-    if (hook->enabled)
+bool HookManager::setHookEnabled(void* target, bool enable)
+{
+    if (!initialize()) return false;
+
+    HookInfo* hook = find(target);
+    if (!hook)
     {
-        auto status = MH_DisableHook(hook->target);
-        if (status != MH_OK)
-        {
-            LOG_ERROR("Failed to disable hook: {}", magic_enum::enum_name(status));
-            return false;
-        }
+        failBatch();
+        return false;
+    }
+
+    // Inside a batch the recorded state is the one from before the batch, queue regardless
+    if (hook->enabled == enable && !m_batchOpen) return true;
+
+    if (!setEnabled(hook->target, enable, false)) return false;
+
+    if (!m_batchOpen) hook->enabled = enable;
+    return true;
+}
+
+HookManager::HookHandle HookManager::findHook(void* target) const
+{
+    std::shared_lock lock(m_mutex);
+
+    const auto it = m_hooks.find(target);
+    return it != m_hooks.end() ? it->second : nullptr;
+}
+
+bool HookManager::isEnabled(void* target) const
+{
+    const auto hook = findHook(target);
+    return hook && hook->enabled.load(std::memory_order_relaxed);
+}
+
+std::vector<HookManager::HookHandle> HookManager::getHooks() const
+{
+    std::vector<HookHandle> hooks;
+    {
+        std::shared_lock lock(m_mutex);
+        hooks.reserve(m_hooks.size());
+        for (const auto& hook : m_hooks | std::views::values) hooks.push_back(hook);
     }
 
-    auto status = MH_RemoveHook(hook->target);
-    if (status != MH_OK)
+    std::ranges::sort(hooks, {}, [](const HookHandle& hook) { return hook->sequence; });
+    return hooks;
+}
+
+bool HookManager::installHook(void* target, void* detour, void* originalKey, uint32_t profileId,
+                              const std::string& moduleName, intptr_t offset)
+{
+    std::unique_lock lock(m_mutex);
+    waitForBatch(lock);
+    if (!initialize()) return false;
+
+    if (!target)
     {
-        LOG_ERROR("Failed to remove hook: {}", magic_enum::enum_name(status));
+        failBatch();
         return false;
     }
 
-    instance.m_detourToOriginal.erase(hook->detour);
-    instance.m_hooks.erase(it);
+    checkTarget(target);
+
+    void* originalPtr = nullptr;
+    if (!m_backend->create(target, detour, &originalPtr))
+    {
+        failBatch();
+        return false;
+    }
 
+    // The detour may run as soon as the hook is enabled, so its slot has to be filled first
+    setOriginal(originalKey, originalPtr);
+
+    if (!setEnabled(target, true, true))
+    {
+        m_backend->remove(target);
+        setOriginal(originalKey, nullptr);
+        return false;
+    }
+
+    auto hookInfo = std::make_shared<HookInfo>(target, originalKey, originalPtr, moduleName, offset);
+    hookInfo->enabled = !m_batchOpen;
+    hookInfo->profileId = profileId;
+    hookInfo->sequence = m_nextSequence++;
+    m_hooks.insert_or_assign(target, std::move(hookInfo));
     return true;
 }
 
-bool HookManager::enableHook(void* target)
+bool HookManager::setEnabled(void* target, bool enable, bool created)
 {
-    if (!initialize() && !m_initialized) return false;
+    if (!m_batchOpen) return enable ? m_backend->enable(target) : m_backend->disable(target);
+
+    if (!(enable ? m_backend->queueEnable(target) : m_backend->queueDisable(target)))
+    {
+        m_batchFailed = true;
+        return false;
+    }
 
-    HookInfo* hook = findHook(target);
-    if (!hook) return false;
+    const auto hook = created ? nullptr : find(target);
+    m_batch.push_back({target, enable, hook && hook->enabled, created});
+    return true;
+}
 
-    if (hook->enabled) return true;
+bool HookManager::beginBatch()
+{
+    auto& instance = getInstance();
+    std::unique_lock lock(instance.m_mutex);
+    instance.waitForBatch(lock);
+    if (!instance.initialize()) return false;
 
-    auto status = MH_EnableHook(hook->target);
-    if (status == MH_OK)
+    if (instance.m_batchOpen)
     {
-        hook->enabled = true;
-        return true;
+        LOG_ERROR("This thread already has a hook batch open");
+        return false;
     }
 
-    return false;
+    instance.m_batchOpen = true;
+    instance.m_batchOwner = std::this_thread::get_id();
+    instance.m_batchFailed = false;
+    instance.m_batch.clear();
+    instance.m_batchRollbacks.clear();
+    return true;
 }
 
-bool HookManager::disableHook(void* target)
+bool HookManager::commitBatch()
 {
-    if (!initialize() && !m_initialized) return false;
+    auto& instance = getInstance();
+    std::unique_lock lock(instance.m_mutex);
+    if (!instance.ownsBatch()) return false;
+
+    if (instance.m_batchFailed)
+    {
+        LOG_ERROR("Hook batch failed, rolling back {} queued changes", instance.m_batch.size());
+        instance.rollbackBatch();
+        instance.closeBatch();
+        return false;
+    }
 
-    HookInfo* hook = findHook(target);
-    if (!hook) return false;
+    // MinHook suspends every other thread once for the whole queue
+    const auto start = std::chrono::steady_clock::now();
+    const auto applied = instance.m_batch.empty() || instance.m_backend->applyQueued();
+    instance.m_lastBatchFreezeMs =
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
 
-    if (!hook->enabled) return true;
+    if (!applied)
+    {
+        LOG_ERROR("Failed to apply hook batch");
+        instance.rollbackBatch();
+        instance.closeBatch();
+        return false;
+    }
 
-    auto status = MH_DisableHook(hook->target);
-    if (status == MH_OK)
+    for (const auto& entry : instance.m_batch)
     {
-        hook->enabled = false;
-        return true;
+        if (const auto hook = instance.find(entry.target)) hook->enabled = entry.enable;
     }
 
-    return false;
+    LOG_INFO("Applied {} hook changes in {:.3f} ms", instance.m_batch.size(), instance.m_lastBatchFreezeMs);
+
+    instance.m_batch.clear();
+    instance.m_batchRollbacks.clear();
+    instance.closeBatch();
+    return true;
 }
 
-HookManager::HookInfo* HookManager::findHook(void* target)
+void HookManager::cancelBatch()
 {
-    auto it = std::ranges::find_if(m_hooks,
-                                   [target](const std::unique_ptr<HookInfo>& hook)
-                                   {
-                                       return hook->target == target;
-                                   });
+    auto& instance = getInstance();
+    std::unique_lock lock(instance.m_mutex);
+    if (!instance.ownsBatch()) return;
+
+    instance.rollbackBatch();
+    instance.closeBatch();
+}
 
-    return it != m_hooks.end() ? it->get() : nullptr;
+void HookManager::onBatchRollback(std::function<void()> callback)
+{
+    auto& instance = getInstance();
+    std::unique_lock lock(instance.m_mutex);
+    if (instance.ownsBatch()) instance.m_batchRollbacks.push_back(std::move(callback));
+}
+
+void HookManager::rollbackBatch()
+{
+    // Queue every touched hook back to its state from before the batch. Going backwards leaves the
+    // oldest recorded state in the queue, and backends skip hooks that are already in that state, so
+    // this also undoes a partially applied queue.
+    for (auto it = m_batch.rbegin(); it != m_batch.rend(); ++it)
+    {
+        if (it->wasEnabled) m_backend->queueEnable(it->target);
+        else m_backend->queueDisable(it->target);
+    }
+    if (!m_batch.empty()) m_backend->applyQueued();
+
+    for (const auto& entry : m_batch)
+    {
+        if (!entry.created) continue;
+
+        const auto it = m_hooks.find(entry.target);
+        if (it == m_hooks.end()) continue;
+
+        m_backend->remove(entry.target);
+        setOriginal(it->second->detour, nullptr);
+        it->second->installed = false;
+        m_hooks.erase(it);
+    }
+
+    for (const auto& callback : m_batchRollbacks) callback();
+
+    m_batch.clear();
+    m_batchRollbacks.clear();
+}
+
+bool HookManager::registerSlot(void* detour, std::atomic<void*>* slot)
+{
+    auto& instance = getInstance();
+    std::lock_guard lock(instance.m_slotMutex);
+
+    instance.m_originalSlots.emplace(detour, slot);
+    if (const auto it = instance.m_detourToOriginal.find(detour); it != instance.m_detourToOriginal.end())
+        slot->store(it->second, std::memory_order_release);
+
+    return true;
+}
+
+void HookManager::setOriginal(void* detour, void* original)
+{
+    std::lock_guard lock(m_slotMutex);
+
+    if (original) m_detourToOriginal[detour] = original;
+    else m_detourToOriginal.erase(detour);
+
+    const auto [begin, end] = m_originalSlots.equal_range(detour);
+    for (auto it = begin; it != end; ++it) it->second->store(original, std::memory_order_release);
+}
+
+std::vector<HookManager::HookStats> HookManager::getHookStats() const
+{
+    std::vector<HookStats> result;
+
+    const auto& profiler = HookProfiler::getInstance();
+    const auto cyclesPerNanosecond = profiler.cyclesPerNanosecond();
+
+    for (const auto& hook : getHooks())
+    {
+        if (hook->profileId == HookProfiler::NO_ID) continue;
+
+        const auto stats = profiler.getStats(hook->profileId);
+        const auto nanoseconds = static_cast<double>(stats.cycles) / cyclesPerNanosecond;
+        result.push_back({
+            hook,
+            stats.calls,
+            nanoseconds / 1e6,
+            stats.calls ? nanoseconds / static_cast<double>(stats.calls) : 0.0,
+            stats.histogram
+        });
+    }
+    return result;
+}
+
+void HookManager::resetHookStats()
+{
+    HookProfiler::getInstance().reset();
+}
+
+HookManager::HookInfo* HookManager::find(void* target) const
+{
+    const auto it = m_hooks.find(target);
+    return it != m_hooks.end() ? it->second.get() : nullptr;
+}
+
+void HookManager::checkTarget(void* target)
+{
+    // A target inside a function usually means an outdated offset or signature
+    const auto address = reinterpret_cast<uintptr_t>(target);
+    const auto index = FunctionIndex::forAddress(address);
+    const auto function = index ? index->find(address) : std::nullopt;
+    if (function && function->begin != address)
+    {
+        LOG_WARN("Hook target {:#x} is {:#x} bytes into function {:#x}", address, address - function->begin,
+                 function->begin);
+    }
 }
 
 void* HookManager::resolveModuleFunction(const std::string& moduleName, intptr_t offset)
 {
+#ifdef _WIN32
     HMODULE hModule = GetModuleHandleA(moduleName.c_str());
     if (!hModule)
     {
@@ -155,4 +452,16 @@ void* HookManager::resolveModuleFunction(const std::string& moduleName, intptr_t
 #endif
 
     return targetFunction;
+#else
+    // dlopen also finds modules that are already loaded, the base comes from the link map
+    const auto handle = dlopen(moduleName.empty() ? nullptr : moduleName.c_str(), RTLD_NOW);
+    link_map* map = nullptr;
+    if (!handle || dlinfo(handle, RTLD_DI_LINKMAP, &map) != 0 || !map)
+    {
+        LOG_ERROR("HookManager: failed to load module {}", moduleName);
+        return nullptr;
+    }
+
+    return reinterpret_cast<void*>(static_cast<intptr_t>(map->l_addr) + offset);
+#endif
 }
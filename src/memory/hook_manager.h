@@ -1,17 +1,27 @@
 ﻿#pragma once
 
+#include "hook_backend.h"
+#include "hook_profiler.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
 #include <vector>
 #include <memory>
-#include <MinHook.h>
+#include <shared_mutex>
+#include <thread>
 
 #ifdef _DEBUG
 #define CALL_ORIGINAL(handler, ...) \
-HookManager::getInstance().callOriginal(handler, __func__, __VA_ARGS__)
+HookManager::callOriginal<handler>(__func__, __VA_ARGS__)
 #else
 #define CALL_ORIGINAL(handler, ...) \
-HookManager::getInstance().callOriginal(handler, __VA_ARGS__)
+HookManager::callOriginal<handler>(__VA_ARGS__)
 #endif
 
+template <auto Detour>
+struct OriginalSlot;
+
 class HookManager
 {
 public:
@@ -20,9 +30,12 @@ public:
         void* target;
         void* detour;
         void* original;
-        bool enabled;
+        std::atomic<bool> enabled;
+        std::atomic<bool> installed{true}; // cleared on uninstall, for handles that outlive the hook
         std::string moduleName;
         intptr_t offset;
+        uint32_t profileId = HookProfiler::NO_ID; // set when installed through install<Detour>
+        uint64_t sequence = 0;                    // install order, getHooks() is sorted by it
 
         HookInfo(void* t, void* d, void* o, std::string module = "", intptr_t off = 0)
             : target(t)
@@ -35,11 +48,28 @@ public:
         }
     };
 
+    // Keeps the HookInfo alive, so 'enabled' can be polled without a lookup or a lock (GUI lists)
+    using HookHandle = std::shared_ptr<const HookInfo>;
+
+    struct HookStats
+    {
+        HookHandle hook;
+        uint64_t calls;
+        double totalMs;    // time spent in the detour, original call included
+        double averageNs;
+        std::array<uint64_t, HookProfiler::HISTOGRAM_BUCKETS> histogram; // see HookProfiler
+    };
+
     static HookManager& getInstance();
 
     // Shutdown and cleanup all hooks
     void shutdown();
 
+    // Replaces the backend (MinHook on Windows, InlineHookBackend elsewhere). Only possible while no hook
+    // is installed, e.g. to run the inline backend on Windows or a fake one in a test binary.
+    static bool setBackend(std::unique_ptr<HookBackend> backend);
+    _NODISCARD const char* getBackendName() const { return m_backend ? m_backend->name() : "none"; }
+
     // Install hook using direct function pointer
     template <typename T>
     static bool install(T target, T detour);
@@ -48,27 +78,96 @@ public:
     template <typename T>
     static bool install(const std::string& moduleName, intptr_t offset, T detour);
 
+    // Same as above with the detour as a template argument, which lets HookProfiler time every call:
+    //   HookManager::install<hookedPresent>(presentAddr);
+    template <auto Detour>
+    static bool install(decltype(Detour) target);
+
+    template <auto Detour>
+    static bool install(const std::string& moduleName, intptr_t offset);
+
     static bool uninstall(void* target);
 
     // Hook management
     bool enableHook(void* target);
     bool disableHook(void* target);
 
+    // Between beginBatch() and commitBatch(), install/enableHook/disableHook only queue their change and
+    // the backend applies all of them at once, MinHook under a single thread freeze. If anything in the
+    // batch fails, every change in it is rolled back and commitBatch() returns false.
+    // A batch belongs to the thread that opened it: only that thread can add to, commit or cancel it, and
+    // mutations from other threads (beginBatch included) wait until it is closed. Don't block on another
+    // thread that may be installing or toggling hooks while a batch is open.
+    static bool beginBatch();
+    static bool commitBatch();
+    static void cancelBatch();
+
+    // Whether the calling thread has a batch open
+    _NODISCARD bool inBatch() const;
+
+    // Runs if the calling thread's open batch is rolled back, so owners of the hooks (FunctionHook) can
+    // reset their state
+    static void onBatchRollback(std::function<void()> callback);
+
+    // Batch for the changes made in a scope. Joins the calling thread's open batch, whose commit then
+    // covers them, otherwise opens one that commit() or the destructor commits.
+    class ScopedBatch
+    {
+    public:
+        ScopedBatch()
+            : m_owned(!getInstance().inBatch() && beginBatch())
+        {
+        }
+
+        ~ScopedBatch() { commit(); }
+
+        ScopedBatch(const ScopedBatch&) = delete;
+        ScopedBatch& operator=(const ScopedBatch&) = delete;
+
+        // False if the batch this scope opened was rolled back. A joined batch is reported by its own commit.
+        bool commit()
+        {
+            if (!m_owned) return true;
+
+            m_owned = false;
+            return commitBatch();
+        }
+
+    private:
+        bool m_owned;
+    };
+
+    // Time spent applying the last batch with all other threads suspended
+    _NODISCARD double getLastBatchFreezeMs() const { return m_lastBatchFreezeMs; }
+
     // Get original function from handler
     template <typename T>
     T getOriginal(T handler) const;
 
-    // Call original function through handler with automatic lookup
+    // Call the original function of a detour through its OriginalSlot, no lookup involved
 #ifdef _DEBUG
-    template <typename RType, typename... Params>
-    RType callOriginal(RType (*handler)(Params...), const char* callerName, Params... params);
+    template <auto Detour, typename... Args>
+    static auto callOriginal(const char* callerName, Args&&... args) -> std::invoke_result_t<decltype(Detour), Args...>;
 #else
-    template <typename RType, typename... Params>
-    RType callOriginal(RType (*handler)(Params...), Params... params);
+    template <auto Detour, typename... Args>
+    static auto callOriginal(Args&&... args) -> std::invoke_result_t<decltype(Detour), Args...>;
 #endif
 
+    // Called once per OriginalSlot instantiation, fills it in if the detour is already installed
+    static bool registerSlot(void* detour, std::atomic<void*>* slot);
+
+    // Counters of every hook installed through install<Detour>, empty when HOOK_PROFILING is off
+    _NODISCARD std::vector<HookStats> getHookStats() const;
+    void resetHookStats();
+
     _NODISCARD bool isInitialized() const { return m_initialized; }
-    _NODISCARD const std::vector<std::unique_ptr<HookInfo>>& getHooks() const { return m_hooks; }
+
+    // Hook of a target through the hash index, nullptr if it is not hooked
+    _NODISCARD HookHandle findHook(void* target) const;
+    _NODISCARD bool isEnabled(void* target) const;
+
+    // Snapshot of all hooks in install order
+    _NODISCARD std::vector<HookHandle> getHooks() const;
 
 private:
     HookManager() = default;
@@ -77,86 +176,102 @@ private:
     HookManager(const HookManager&) = delete;
     HookManager& operator=(const HookManager&) = delete;
 
-    std::vector<std::unique_ptr<HookInfo>> m_hooks;
+    // Every mutation (install, toggle, batch, shutdown) holds m_mutex exclusively, lookups share it.
+    // Mutations also wait on m_batchClosed while another thread's batch is open.
+    // Rollback callbacks run under it too and must not call back into HookManager.
+    mutable std::shared_mutex m_mutex;
+    std::unique_ptr<HookBackend> m_backend;
+    std::unordered_map<void*, std::shared_ptr<HookInfo>> m_hooks; // by target
+    uint64_t m_nextSequence = 0;
+    std::atomic<bool> m_initialized = false;
+
     std::unordered_map<void*, void*> m_detourToOriginal;
-    bool m_initialized = false;
+    std::unordered_multimap<void*, std::atomic<void*>*> m_originalSlots;
+    mutable std::mutex m_slotMutex;
+
+    struct BatchEntry
+    {
+        void* target;
+        bool enable;
+        bool wasEnabled; // state before the batch, restored on rollback
+        bool created;    // installed by this batch, removed again on rollback
+    };
 
+    std::atomic<bool> m_batchOpen = false;
+    std::thread::id m_batchOwner;
+    std::condition_variable_any m_batchClosed;
+    bool m_batchFailed = false;
+    std::vector<BatchEntry> m_batch;
+    std::vector<std::function<void()>> m_batchRollbacks;
+    double m_lastBatchFreezeMs = 0.0;
+
+    // Called with m_mutex held
+    void waitForBatch(std::unique_lock<std::shared_mutex>& lock);
+    _NODISCARD bool ownsBatch() const;
+    void closeBatch();
     bool initialize();
-    HookInfo* findHook(void* target);
+    bool setHookEnabled(void* target, bool enable);
+    HookInfo* find(void* target) const;
+    bool setEnabled(void* target, bool enable, bool created);
+
+    bool installHook(void* target, void* detour, void* originalKey, uint32_t profileId,
+                     const std::string& moduleName = "", intptr_t offset = 0);
+    void rollbackBatch();
+    void failBatch() { m_batchFailed |= m_batchOpen; }
+    void setOriginal(void* detour, void* original);
+    static void checkTarget(void* target);
     void* resolveModuleFunction(const std::string& moduleName, intptr_t offset);
 };
 
 template <typename T>
 bool HookManager::install(T target, T detour)
 {
-    auto& instance = getInstance();
-    if (!instance.initialize() && !instance.m_initialized) return false;
-
-    void* originalPtr = nullptr;
-    auto status = MH_CreateHook(reinterpret_cast<void*>(target), reinterpret_cast<void*>(detour), &originalPtr);
-    if (status != MH_OK)
-    {
-        LOG_ERROR("Failed to create hook {}", magic_enum::enum_name(status));
-        return false;
-    }
-
-    status = MH_EnableHook(reinterpret_cast<void*>(target));
-    if (status != MH_OK)
-    {
-        MH_RemoveHook(reinterpret_cast<void*>(target));
-        LOG_ERROR("Failed to enable hook: {}", magic_enum::enum_name(status));
-        return false;
-    }
-
-    auto hookInfo = std::make_unique<HookInfo>(reinterpret_cast<void*>(target), reinterpret_cast<void*>(detour),
-                                               originalPtr);
-    hookInfo->enabled = true;
-    instance.m_hooks.push_back(std::move(hookInfo));
-
-    // Add to fast lookup map
-    instance.m_detourToOriginal[reinterpret_cast<void*>(detour)] = originalPtr;
-    return true;
+    return getInstance().installHook(reinterpret_cast<void*>(target), reinterpret_cast<void*>(detour),
+                                     reinterpret_cast<void*>(detour), HookProfiler::NO_ID);
 }
 
 template <typename T>
 bool HookManager::install(const std::string& moduleName, intptr_t offset, T detour)
 {
+    // A target that could not be resolved fails the open batch in installHook
     auto& instance = getInstance();
-    if (!instance.initialize() && !instance.m_initialized) return false;
-
-    void* target = instance.resolveModuleFunction(moduleName, offset);
-    if (!target) return false;
-
-    void* originalPtr = nullptr;
-    auto status = MH_CreateHook(target, reinterpret_cast<void*>(detour), &originalPtr);
-    if (status != MH_OK)
-    {
-        LOG_ERROR("Failed to create hook %d", magic_enum::enum_name(status));
-        return false;
-    }
-
-    status = MH_EnableHook(target);
-    if (status != MH_OK)
-    {
-        MH_RemoveHook(target);
-        LOG_ERROR("Failed to enable hook: %d", magic_enum::enum_name(status));
-        return false;
-    }
+    return instance.installHook(instance.resolveModuleFunction(moduleName, offset), reinterpret_cast<void*>(detour),
+                                reinterpret_cast<void*>(detour), HookProfiler::NO_ID, moduleName, offset);
+}
 
-    auto hookInfo = std::make_unique<
-        HookInfo>(target, reinterpret_cast<void*>(detour), originalPtr, moduleName, offset);
-    hookInfo->enabled = true;
-    instance.m_hooks.push_back(std::move(hookInfo));
+template <auto Detour>
+bool HookManager::install(decltype(Detour) target)
+{
+#if HOOK_PROFILING
+    return getInstance().installHook(reinterpret_cast<void*>(target),
+                                     reinterpret_cast<void*>(&ProfiledDetour<Detour>::invoke),
+                                     reinterpret_cast<void*>(Detour), ProfiledDetour<Detour>::id);
+#else
+    return install(target, Detour);
+#endif
+}
 
-    instance.m_detourToOriginal[reinterpret_cast<void*>(detour)] = originalPtr;
-    return true;
+template <auto Detour>
+bool HookManager::install(const std::string& moduleName, intptr_t offset)
+{
+#if HOOK_PROFILING
+    auto& instance = getInstance();
+    return instance.installHook(instance.resolveModuleFunction(moduleName, offset),
+                                reinterpret_cast<void*>(&ProfiledDetour<Detour>::invoke),
+                                reinterpret_cast<void*>(Detour), ProfiledDetour<Detour>::id, moduleName, offset);
+#else
+    return install(moduleName, offset, Detour);
+#endif
 }
 
 template <typename T>
 T HookManager::getOriginal(T handler) const
 {
-    auto it = m_detourToOriginal.find(reinterpret_cast<void*>(handler));
-    if (it != m_detourToOriginal.end()) return reinterpret_cast<T>(it->second);
+    {
+        std::lock_guard lock(m_slotMutex);
+        auto it = m_detourToOriginal.find(reinterpret_cast<void*>(handler));
+        if (it != m_detourToOriginal.end()) return reinterpret_cast<T>(it->second);
+    }
 
 #ifdef _DEBUG
     // In debug mode, provide more detailed error information
@@ -166,13 +281,28 @@ T HookManager::getOriginal(T handler) const
     return nullptr;
 }
 
+// Trampoline of a single detour. Each detour function gets its own static, so CALL_ORIGINAL is a load
+// and an indirect call. The slot registers itself with HookManager during static initialization and is
+// written whenever the detour is installed or removed.
+template <auto Detour>
+struct OriginalSlot
+{
+    static inline std::atomic<void*> value{nullptr};
+    static inline const bool registered = HookManager::registerSlot(reinterpret_cast<void*>(Detour), &value);
+};
+
 #ifdef _DEBUG
-template <typename RType, typename... Params>
-RType HookManager::callOriginal(RType (*handler)(Params...), const char* callerName, Params... params)
+template <auto Detour, typename... Args>
+auto HookManager::callOriginal(const char* callerName, Args&&... args)
+    -> std::invoke_result_t<decltype(Detour), Args...>
 {
-    auto original = getOriginal(handler);
+    using RType = std::invoke_result_t<decltype(Detour), Args...>;
+
+    (void)OriginalSlot<Detour>::registered;
+    const auto original = reinterpret_cast<decltype(Detour)>(OriginalSlot<Detour>::value.load(
+        std::memory_order_acquire));
     if (original != nullptr)
-        return original(params...);
+        return original(std::forward<Args>(args)...);
 
     if (callerName)
     {
@@ -181,15 +311,19 @@ RType HookManager::callOriginal(RType (*handler)(Params...), const char* callerN
         OutputDebugStringA(debugMsg.c_str());
     }
 
-    return RType{};
+    if constexpr (!std::is_void_v<RType>) return RType{};
 }
 #else
-template <typename RType, typename... Params>
-RType HookManager::callOriginal(RType (*handler)(Params...), Params... params)
+template <auto Detour, typename... Args>
+auto HookManager::callOriginal(Args&&... args) -> std::invoke_result_t<decltype(Detour), Args...>
 {
-    auto original = getOriginal(handler);
-    if (original != nullptr) return original(params...);
+    using RType = std::invoke_result_t<decltype(Detour), Args...>;
+
+    (void)OriginalSlot<Detour>::registered;
+    const auto original = reinterpret_cast<decltype(Detour)>(OriginalSlot<Detour>::value.load(
+        std::memory_order_acquire));
+    if (original != nullptr) return original(std::forward<Args>(args)...);
 
-    return RType{};
+    if constexpr (!std::is_void_v<RType>) return RType{};
 }
 #endif
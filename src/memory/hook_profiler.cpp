@@ -0,0 +1,117 @@
+﻿#include "pch.h"
+#include "hook_profiler.h"
+
+#include <chrono>
+
+thread_local HookProfiler::ThreadBlock* HookProfiler::t_block = nullptr;
+
+namespace
+{
+    int64_t nanosecondsNow()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+}
+
+HookProfiler& HookProfiler::getInstance()
+{
+    static HookProfiler instance;
+    return instance;
+}
+
+HookProfiler::HookProfiler()
+    : m_startCycles(timestamp())
+    , m_startNanoseconds(nanosecondsNow())
+{
+}
+
+uint32_t HookProfiler::allocateId()
+{
+    const auto id = m_nextId.fetch_add(1, std::memory_order_relaxed);
+    if (id < MAX_HOOKS) return id;
+
+    LOG_WARN("More than {} profiled hooks, the rest are not instrumented", MAX_HOOKS);
+    return NO_ID;
+}
+
+HookProfiler::ThreadBlock* HookProfiler::attachThread()
+{
+    // Constructed on the first hooked call of each thread, its destructor runs when the thread exits
+    thread_local ThreadGuard guard;
+
+    auto block = std::make_unique<ThreadBlock>();
+    t_block = block.get();
+
+    std::lock_guard lock(m_mutex);
+    m_blocks.push_back(std::move(block));
+    return t_block;
+}
+
+HookProfiler::ThreadGuard::~ThreadGuard()
+{
+    if (t_block) getInstance().detachThread(t_block);
+    t_block = nullptr;
+}
+
+void HookProfiler::detachThread(ThreadBlock* block)
+{
+    std::lock_guard lock(m_mutex);
+
+    for (size_t id = 0; id < MAX_HOOKS; ++id)
+    {
+        auto& retired = m_retired[id];
+        const auto& counters = block->counters[id];
+
+        retired.calls += counters.calls.load(std::memory_order_relaxed);
+        retired.cycles += counters.cycles.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < HISTOGRAM_BUCKETS; ++i)
+            retired.histogram[i] += counters.histogram[i].load(std::memory_order_relaxed);
+    }
+
+    std::erase_if(m_blocks, [block](const std::unique_ptr<ThreadBlock>& owned) { return owned.get() == block; });
+}
+
+HookProfiler::Stats HookProfiler::getStats(uint32_t id) const
+{
+    if (id >= MAX_HOOKS) return {};
+
+    std::lock_guard lock(m_mutex);
+
+    auto stats = m_retired[id];
+    for (const auto& block : m_blocks)
+    {
+        const auto& counters = block->counters[id];
+
+        stats.calls += counters.calls.load(std::memory_order_relaxed);
+        stats.cycles += counters.cycles.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < HISTOGRAM_BUCKETS; ++i)
+            stats.histogram[i] += counters.histogram[i].load(std::memory_order_relaxed);
+    }
+    return stats;
+}
+
+void HookProfiler::reset()
+{
+    std::lock_guard lock(m_mutex);
+
+    // A call being recorded at the same moment may survive the reset, which is fine for statistics
+    m_retired = {};
+    for (const auto& block : m_blocks)
+    {
+        for (auto& counters : block->counters)
+        {
+            counters.calls.store(0, std::memory_order_relaxed);
+            counters.cycles.store(0, std::memory_order_relaxed);
+            for (auto& bucket : counters.histogram) bucket.store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+double HookProfiler::cyclesPerNanosecond() const
+{
+    const auto elapsed = nanosecondsNow() - m_startNanoseconds;
+    if (elapsed <= 0) return 1.0;
+
+    return static_cast<double>(timestamp() - m_startCycles) / static_cast<double>(elapsed);
+}
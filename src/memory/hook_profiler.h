@@ -0,0 +1,153 @@
+﻿#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+
+// On in Debug builds only. Define HOOK_PROFILING=1 (C/C++ > Preprocessor in the project, or
+// -DHOOK_PROFILING=1) to profile a Release build. With 0 the instrumentation is compiled out and
+// HookManager::install<Detour> installs the detour as is.
+#ifndef HOOK_PROFILING
+#ifdef _DEBUG
+#define HOOK_PROFILING 1
+#else
+#define HOOK_PROFILING 0
+#endif
+#endif
+
+// Call counts, time and a latency histogram per hooked detour. Timestamps come from the TSC and every
+// thread records into its own counter block, so a call costs two rdtsc and a few plain stores. Blocks
+// are summed when the stats are read.
+class HookProfiler
+{
+public:
+    static HookProfiler& getInstance();
+
+    static constexpr uint32_t NO_ID = UINT32_MAX;
+    static constexpr size_t MAX_HOOKS = 128;
+
+    // Bucket i counts calls that took [2^(i-1), 2^i) cycles, the last bucket also takes everything above
+    static constexpr size_t HISTOGRAM_BUCKETS = 32;
+
+    struct Stats
+    {
+        uint64_t calls = 0;
+        uint64_t cycles = 0;
+        std::array<uint64_t, HISTOGRAM_BUCKETS> histogram{};
+    };
+
+    // Id for a new instrumented detour, NO_ID once MAX_HOOKS are in use
+    uint32_t allocateId();
+
+    _NODISCARD Stats getStats(uint32_t id) const;
+    void reset();
+
+    // Measured TSC rate, used to turn cycles into time
+    _NODISCARD double cyclesPerNanosecond() const;
+
+    static uint64_t timestamp() { return __rdtsc(); }
+
+    static void record(uint32_t id, uint64_t cycles)
+    {
+        if (id >= MAX_HOOKS) return;
+
+        auto* block = t_block;
+        if (!block) block = getInstance().attachThread();
+
+        // Only this thread writes the block, the atomics just keep the readers well defined
+        auto& counters = block->counters[id];
+        const auto bump = [](std::atomic<uint64_t>& value, uint64_t amount)
+        {
+            value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+        };
+        bump(counters.calls, 1);
+        bump(counters.cycles, cycles);
+        const auto bucket = (std::min)(static_cast<size_t>(std::bit_width(cycles)), HISTOGRAM_BUCKETS - 1);
+        bump(counters.histogram[bucket], 1);
+    }
+
+    // Times the enclosing scope
+    class Scope
+    {
+    public:
+        explicit Scope(uint32_t id)
+            : m_id(id)
+            , m_start(timestamp())
+        {
+        }
+
+        ~Scope() { record(m_id, timestamp() - m_start); }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        uint32_t m_id;
+        uint64_t m_start;
+    };
+
+    HookProfiler(const HookProfiler&) = delete;
+    HookProfiler& operator=(const HookProfiler&) = delete;
+
+private:
+    HookProfiler();
+
+    struct Counters
+    {
+        std::atomic<uint64_t> calls{0};
+        std::atomic<uint64_t> cycles{0};
+        std::array<std::atomic<uint64_t>, HISTOGRAM_BUCKETS> histogram{};
+    };
+
+    struct ThreadBlock
+    {
+        std::array<Counters, MAX_HOOKS> counters;
+    };
+
+    // Folds the counters of an exiting thread into m_retired and drops its block
+    struct ThreadGuard
+    {
+        ~ThreadGuard();
+    };
+
+    ThreadBlock* attachThread();
+    void detachThread(ThreadBlock* block);
+
+    static thread_local ThreadBlock* t_block;
+
+    mutable std::mutex m_mutex;
+    std::vector<std::unique_ptr<ThreadBlock>> m_blocks;
+    std::array<Stats, MAX_HOOKS> m_retired{};
+    std::atomic<uint32_t> m_nextId{0};
+
+    uint64_t m_startCycles;
+    int64_t m_startNanoseconds;
+};
+
+#if HOOK_PROFILING
+// Stand-in installed in front of a detour known at compile time, timing every call to it
+template <auto Detour>
+struct ProfiledDetour;
+
+template <typename R, typename... Args, R (*Detour)(Args...)>
+struct ProfiledDetour<Detour>
+{
+    static inline const uint32_t id = HookProfiler::getInstance().allocateId();
+
+    static R invoke(Args... args)
+    {
+        HookProfiler::Scope scope(id);
+        return Detour(std::forward<Args>(args)...);
+    }
+};
+#endif
@@ -0,0 +1,219 @@
+﻿#include "pch.h"
+#include "inline_hook_backend.h"
+
+#include "code_relocator.h"
+#include "nearby_arena.h"
+#include "patch_set.h"
+#include "virtual_memory.h"
+
+#include <cstring>
+#include <ranges>
+
+namespace
+{
+    constexpr size_t NEAR_JUMP_SIZE = 5;
+    constexpr size_t RELAY_SIZE = CodeRelocator::ABSOLUTE_JUMP_SIZE;
+    constexpr size_t TRAMPOLINE_SIZE =
+        RELAY_SIZE + CodeRelocator::maxSize(PatchSet::JUMP_SIZE) + CodeRelocator::ABSOLUTE_JUMP_SIZE;
+}
+
+bool InlineHookBackend::initialize()
+{
+    std::lock_guard lock(m_mutex);
+    m_initialized = true;
+    return true;
+}
+
+void InlineHookBackend::uninitialize()
+{
+    std::vector<uintptr_t> targets;
+    {
+        std::lock_guard lock(m_mutex);
+        for (const auto& target : m_hooks | std::views::keys) targets.push_back(target);
+    }
+
+    for (const auto target : targets) remove(reinterpret_cast<void*>(target));
+
+    std::lock_guard lock(m_mutex);
+    m_initialized = false;
+}
+
+bool InlineHookBackend::create(void* target, void* detour, void** original)
+{
+    std::lock_guard lock(m_mutex);
+
+    const auto address = reinterpret_cast<uintptr_t>(target);
+    if (!m_initialized || !target || !detour)
+    {
+        LOG_ERROR("Inline hook: invalid call to create on {:p}", target);
+        return false;
+    }
+
+    if (m_hooks.contains(address))
+    {
+        LOG_ERROR("Inline hook: {:p} is already hooked", target);
+        return false;
+    }
+
+    if (!VirtualMemory::isReadable(address, PatchSet::JUMP_SIZE))
+    {
+        LOG_ERROR("Inline hook: {:p} is not readable", target);
+        return false;
+    }
+
+    const auto trampoline = NearbyArena::getInstance().allocate(address, TRAMPOLINE_SIZE);
+    if (!trampoline) return false;
+
+    const auto relay = reinterpret_cast<uintptr_t>(trampoline);
+    const auto distance = static_cast<int64_t>(relay - (address + NEAR_JUMP_SIZE));
+    const bool nearJump = distance >= INT32_MIN && distance <= INT32_MAX;
+
+    auto relocated = CodeRelocator::relocate(address, nearJump ? NEAR_JUMP_SIZE : PatchSet::JUMP_SIZE,
+                                             relay + RELAY_SIZE);
+    if (!relocated)
+    {
+        LOG_ERROR("Inline hook: failed to relocate the prologue of {:p}", target);
+        NearbyArena::getInstance().free(trampoline);
+        return false;
+    }
+
+    // relay, relocated instructions, jump back behind them unless they end in a ret or jmp
+    std::vector<uint8_t> code;
+    CodeRelocator::appendJump(code, reinterpret_cast<uintptr_t>(detour));
+    code.insert(code.end(), relocated->code.begin(), relocated->code.end());
+    if (relocated->fallsThrough) CodeRelocator::appendJump(code, address + relocated->sourceLength);
+
+    memcpy(trampoline, code.data(), code.size());
+    VirtualMemory::flushInstructionCache(relay, code.size());
+
+    Hook hook{address, trampoline};
+    hook.original.assign(reinterpret_cast<const uint8_t*>(address),
+                         reinterpret_cast<const uint8_t*>(address) + relocated->sourceLength);
+
+    if (nearJump)
+    {
+        const auto rel = static_cast<int32_t>(distance);
+        hook.patch.push_back(0xE9);
+        hook.patch.insert(hook.patch.end(), reinterpret_cast<const uint8_t*>(&rel),
+                          reinterpret_cast<const uint8_t*>(&rel) + sizeof(rel));
+    }
+    else
+    {
+        CodeRelocator::appendJump(hook.patch, reinterpret_cast<uintptr_t>(detour));
+    }
+    hook.patch.resize(relocated->sourceLength, 0x90);
+
+    if (original) *original = reinterpret_cast<void*>(relay + RELAY_SIZE);
+    m_hooks.emplace(address, std::move(hook));
+    return true;
+}
+
+bool InlineHookBackend::remove(void* target)
+{
+    std::lock_guard lock(m_mutex);
+
+    const auto it = m_hooks.find(reinterpret_cast<uintptr_t>(target));
+    if (it == m_hooks.end())
+    {
+        LOG_ERROR("Inline hook: {:p} is not hooked", target);
+        return false;
+    }
+
+    auto& hook = it->second;
+    if (hook.enabled && !write({&hook}, {false})) return false;
+
+    NearbyArena::getInstance().free(hook.trampoline);
+    m_hooks.erase(it);
+    return true;
+}
+
+bool InlineHookBackend::enable(void* target)
+{
+    return setEnabled(target, true);
+}
+
+bool InlineHookBackend::disable(void* target)
+{
+    return setEnabled(target, false);
+}
+
+bool InlineHookBackend::queueEnable(void* target)
+{
+    return queue(target, true);
+}
+
+bool InlineHookBackend::queueDisable(void* target)
+{
+    return queue(target, false);
+}
+
+bool InlineHookBackend::applyQueued()
+{
+    std::lock_guard lock(m_mutex);
+
+    std::vector<Hook*> hooks;
+    std::vector<bool> states;
+    for (auto& hook : m_hooks | std::views::values)
+    {
+        if (hook.queued && *hook.queued != hook.enabled)
+        {
+            hooks.push_back(&hook);
+            states.push_back(*hook.queued);
+        }
+        hook.queued.reset();
+    }
+
+    return write(hooks, states);
+}
+
+bool InlineHookBackend::setEnabled(void* target, bool enable)
+{
+    std::lock_guard lock(m_mutex);
+
+    const auto it = m_hooks.find(reinterpret_cast<uintptr_t>(target));
+    if (it == m_hooks.end())
+    {
+        LOG_ERROR("Inline hook: {:p} is not hooked", target);
+        return false;
+    }
+
+    auto& hook = it->second;
+    if (hook.enabled == enable) return true;
+    return write({&hook}, {enable});
+}
+
+bool InlineHookBackend::queue(void* target, bool enable)
+{
+    std::lock_guard lock(m_mutex);
+
+    const auto it = m_hooks.find(reinterpret_cast<uintptr_t>(target));
+    if (it == m_hooks.end())
+    {
+        LOG_ERROR("Inline hook: {:p} is not hooked", target);
+        return false;
+    }
+
+    it->second.queued = enable;
+    return true;
+}
+
+bool InlineHookBackend::write(const std::vector<Hook*>& hooks, const std::vector<bool>& states)
+{
+    std::vector<PatchSet::Write> writes;
+    writes.reserve(hooks.size());
+    for (size_t i = 0; i < hooks.size(); ++i)
+    {
+        const auto& bytes = states[i] ? hooks[i]->patch : hooks[i]->original;
+        writes.push_back({hooks[i]->target, bytes.data(), bytes.size()});
+    }
+
+    // One protection change per run of pages for the whole queue
+    if (!PatchSet::writeAll(writes))
+    {
+        LOG_ERROR("Inline hook: failed to write {} hooks", hooks.size());
+        return false;
+    }
+
+    for (size_t i = 0; i < hooks.size(); ++i) hooks[i]->enabled = states[i];
+    return true;
+}
@@ -0,0 +1,54 @@
+﻿#pragma once
+
+#include "hook_backend.h"
+
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+// x86-64 inline hooks without MinHook, the default outside Windows. The target's first instructions are
+// moved into a trampoline from the NearbyArena with CodeRelocator and replaced by a rel32 jump to a relay
+// next to the trampoline, which jumps on to the detour. If the arena can only hand out memory out of reach,
+// the target gets a 14 byte absolute jump straight to the detour instead.
+//
+// Code is written through PatchSet::writeAll (mprotect/VirtualProtect). Unlike MinHook, other threads are
+// not suspended, so a hook should not be toggled while another thread may be executing its first bytes.
+class InlineHookBackend final : public HookBackend
+{
+public:
+    _NODISCARD const char* name() const override { return "Inline"; }
+
+    bool initialize() override;
+    void uninitialize() override;
+
+    bool create(void* target, void* detour, void** original) override;
+    bool remove(void* target) override;
+
+    bool enable(void* target) override;
+    bool disable(void* target) override;
+
+    bool queueEnable(void* target) override;
+    bool queueDisable(void* target) override;
+    bool applyQueued() override;
+
+private:
+    struct Hook
+    {
+        uintptr_t target = 0;
+        void* trampoline = nullptr;       // relay to the detour, then the relocated instructions
+        std::vector<uint8_t> original{};  // bytes replaced at the target, whole instructions
+        std::vector<uint8_t> patch{};     // jump to the relay, padded with nops
+        bool enabled = false;
+        std::optional<bool> queued{};
+    };
+
+    bool setEnabled(void* target, bool enable);
+    bool queue(void* target, bool enable);
+    static bool write(const std::vector<Hook*>& hooks, const std::vector<bool>& states);
+
+    std::mutex m_mutex;
+    std::unordered_map<uintptr_t, Hook> m_hooks;
+    bool m_initialized = false;
+};
@@ -1,26 +1,17 @@
 ﻿#include "pch.h"
 #include "mem.h"
 
-std::unordered_map<void*, Mem::PatchInfo> Mem::m_patches;
+#include "nearby_arena.h"
+#include "patch_set.h"
+#include "scanner.h"
+
+PatchIndex Mem::m_patches;
 
 void Mem::patch(void* address, const char* bytes, size_t len)
 {
-    auto it = m_patches.find(address);
-    if (it == m_patches.end())
-    {
-        // If a patch doesn't exist, create a new one
-        PatchInfo info;
-        info.address = address;
-        info.originalBytes.resize(len);
-        memcpy(info.originalBytes.data(), address, len);
-        // Store the patch info
-        m_patches[address] = info;
-    }
-
-    DWORD oldProtect;
-    VirtualProtect(address, len, PAGE_EXECUTE_READWRITE, &oldProtect);
-    memcpy(address, bytes, len);
-    VirtualProtect(address, len, oldProtect, &oldProtect);
+    PatchSet set;
+    set.patch(reinterpret_cast<uintptr_t>(address), bytes, len);
+    set.commit();
 }
 
 void Mem::patch(uintptr_t address, const char* bytes)
@@ -30,24 +21,20 @@ void Mem::patch(uintptr_t address, const char* bytes)
 
 void Mem::nop(uintptr_t address, const size_t len)
 {
-    std::vector<BYTE> nops(len, 0x90);
+    std::vector<uint8_t> nops(len, 0x90);
     patch(reinterpret_cast<void*>(address), reinterpret_cast<const char*>(nops.data()), len);
 }
 
 void Mem::restore(uintptr_t address)
 {
-    auto it = m_patches.find(reinterpret_cast<void*>(address));
-    if (it != m_patches.end())
+    // Any address inside a patch restores the whole patch
+    if (const auto info = m_patches.find(address))
     {
         // Restore the original bytes
-        const auto& info = it->second;
-        DWORD oldProtect;
-        VirtualProtect(info.address, info.originalBytes.size(), PAGE_EXECUTE_READWRITE, &oldProtect);
-        memcpy(info.address, info.originalBytes.data(), info.originalBytes.size());
-        VirtualProtect(info.address, info.originalBytes.size(), oldProtect, &oldProtect);
+        PatchSet::writeAll({{info->begin(), info->originalBytes.data(), info->originalBytes.size()}});
 
         // Remove the patch info
-        m_patches.erase(it);
+        m_patches.erase(address);
     }
 }
 
@@ -56,158 +43,84 @@ void Mem::restore(std::initializer_list<uintptr_t> address)
     for (const auto addr : address) restore(addr);
 }
 
-uintptr_t Mem::patternScan(uintptr_t module, const char* signature)
+uintptr_t Mem::patternScan(uintptr_t module, const char* signature, SectionKind kind)
 {
-    static auto patternToByte = [](const char* pattern)
-    {
-        auto bytes = std::vector<int>{};
-        const auto start = const_cast<char*>(pattern);
-        const auto end = const_cast<char*>(pattern) + strlen(pattern);
-
-        for (auto current = start; current < end; ++current)
-        {
-            if (*current == '?')
-            {
-                ++current;
-                if (*current == '?' && current < end) ++current;
-                bytes.push_back(-1);
-            }
-            else
-            {
-                bytes.push_back(strtoul(current, &current, 16));
-            }
-        }
-        return bytes;
-    };
-
-    const auto dosHeader = reinterpret_cast<PIMAGE_DOS_HEADER>(module);
-    const auto ntHeaders = reinterpret_cast<PIMAGE_NT_HEADERS>(reinterpret_cast<uint8_t*>(module) + dosHeader->
-        e_lfanew);
-
-    const auto sizeOfImage = ntHeaders->OptionalHeader.SizeOfImage;
-    auto patternBytes = patternToByte(signature);
-    const auto scanBytes = reinterpret_cast<uint8_t*>(module);
-
-    const auto s = patternBytes.size();
-    const auto d = patternBytes.data();
-
-    for (auto i = 0ul; i < sizeOfImage - s; ++i)
+    return patternScan(module, Signature(signature), kind);
+}
+
+uintptr_t Mem::patternScan(uintptr_t module, const Signature& signature, SectionKind kind)
+{
+    if (!signature.valid())
     {
-        bool found = true;
-        for (auto j = 0ul; j < s; ++j)
-        {
-            if (scanBytes[i + j] != d[j] && d[j] != -1)
-            {
-                found = false;
-                break;
-            }
-        }
-        if (found)
-        {
-            // return reinterpret_cast<uintptr_t>(&scanBytes[i]);
-            // Return the address of the pattern
-            return module + i;
-        }
+        LOG_ERROR("Invalid signature passed to patternScan");
+        return 0;
     }
-    return 0;
+
+    return Scanner::scanModule(module, signature, kind);
 }
 
-void* Mem::allocateNearbyMemory(uintptr_t address, size_t size)
+MatchRange<Signature> Mem::patternScanAll(uintptr_t module, const char* signature, SectionKind kind)
 {
-    // Get the system allocation granularity
-    SYSTEM_INFO si;
-    GetSystemInfo(&si);
-
-    // Calculate the start and end addresses within 2GB range for x64
-    constexpr uintptr_t maxDistance = 0x7FF00000; // ~2GB for relative jumps
-    auto start = address > maxDistance ? address - maxDistance : 0;
-    auto end = address + maxDistance;
+    return patternScanAll(module, Signature(signature), kind);
+}
 
-    // Align to allocation granularity
-    start = start / si.dwAllocationGranularity * si.dwAllocationGranularity;
+MatchRange<Signature> Mem::patternScanAll(uintptr_t module, const Signature& signature, SectionKind kind)
+{
+    if (!signature.valid()) LOG_ERROR("Invalid signature passed to patternScanAll");
+    return Scanner::scanModuleAll(module, signature, kind);
+}
 
-    // Iterate through the memory range and find a suitable location
-    MEMORY_BASIC_INFORMATION mbi;
-    for (auto current = start; current < end; current += si.dwAllocationGranularity)
+std::vector<std::vector<uintptr_t>> Mem::patternScanBatch(uintptr_t module, const MultiScanner& scanner,
+                                                          bool allMatches, SectionKind kind)
+{
+    for (size_t i = 0; i < scanner.size(); ++i)
     {
-        if (!VirtualQuery(reinterpret_cast<LPCVOID>(current), &mbi, sizeof(mbi))) continue;
-
-        // If the memory is free and large enough, allocate it
-        if (mbi.State == MEM_FREE && mbi.RegionSize >= size)
-        {
-            auto ptr = VirtualAlloc(reinterpret_cast<LPVOID>(current), size, MEM_COMMIT | MEM_RESERVE,
-                                    PAGE_EXECUTE_READWRITE);
-            if (ptr) return ptr;
-        }
+        if (!scanner.signature(i).valid()) LOG_ERROR("Invalid signature at index {} passed to patternScanBatch", i);
     }
 
-    // If we couldn't find a suitable location, just allocate the memory anywhere
-    return VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+    const auto mode = allMatches ? MultiScanner::Mode::AllMatches : MultiScanner::Mode::FirstMatch;
+    return Scanner::scanModule(module, scanner, mode, kind);
+}
+
+void* Mem::allocateNearbyMemory(uintptr_t address, size_t size)
+{
+    // Sub-allocated from a block within rel32 reach, see NearbyArena
+    return NearbyArena::getInstance().allocate(address, size);
 }
 
 void Mem::createTrampoline(uintptr_t address, void* destination, size_t length)
 {
     // Check if the length is at least 14 bytes
-    if (length < 14) return;
-
-    // Create a byte array based on the length
-    std::vector<BYTE> trampoline(length, 0x90);
+    if (length < PatchSet::JUMP_SIZE) return;
 
-    // Set the jmp [rip] opcode
-    trampoline[0] = 0xFF;
-    trampoline[1] = 0x25;
-    memset(&trampoline[2], 0, 4);
-
-    // Copy the destination address to the place holder of the trampoline
-    memcpy(&trampoline[6], &destination, 8);
-
-    auto it = m_patches.find(reinterpret_cast<void*>(address));
-    if (it != m_patches.end())
-    {
-        // If a patch already exists, update the info with the new trampoline
-        it->second.hasTrampoline = true;
-        it->second.trampolineDestination = destination;
-    }
-    else
-    {
-        // If a patch doesn't exist, create a new one
-        PatchInfo info;
-        info.address = reinterpret_cast<void*>(address);
-        info.originalBytes.resize(length);
-        memcpy(info.originalBytes.data(), reinterpret_cast<void*>(address), length);
-        info.hasTrampoline = true;
-        info.trampolineDestination = destination;
-        // Store the patch info
-        m_patches[reinterpret_cast<void*>(address)] = info;
-    }
-
-    // Patch the original function with the trampoline
-    patch(reinterpret_cast<void*>(address), reinterpret_cast<const char*>(trampoline.data()), trampoline.size());
+    // Patch the original function with a jmp [rip] to the destination
+    PatchSet set;
+    set.jump(address, destination, length);
+    set.commit();
 }
 
 void Mem::removeTrampoline(uintptr_t address)
 {
-    auto it = m_patches.find(reinterpret_cast<void*>(address));
-    if (it != m_patches.end())
-    {
-        if (!it->second.hasTrampoline) return;
+    const auto info = m_patches.find(address);
+    if (!info || !info->hasTrampoline) return;
 
-        // Free the allocated memory for the trampoline
-        VirtualFree(it->second.trampolineDestination, 0, MEM_RELEASE);
+    const auto destination = info->trampolineDestination;
 
-        // Restore the original bytes
-        restore(reinterpret_cast<uintptr_t>(it->second.address));
-    }
+    // Restore the original bytes first, the trampoline is in use until then
+    restore(address);
+
+    // Hand the trampoline back to the arena
+    NearbyArena::getInstance().free(destination);
 }
 
-void Mem::writeInstructions(void* destination, const BYTE instructions[], size_t instructionLen,
+void Mem::writeInstructions(void* destination, const uint8_t instructions[], size_t instructionLen,
                             uintptr_t retAddress)
 {
     // Calculate the length of the instructions plus the far jump
     auto length = instructionLen + 14;
 
     // Create a buffer to store the instructions and the far jump
-    std::vector<BYTE> buffer(length, 0x00);
+    std::vector<uint8_t> buffer(length, 0x00);
 
     // Copy the instructions to the buffer
     memcpy(buffer.data(), instructions, instructionLen);
@@ -226,10 +139,31 @@ void Mem::writeInstructions(void* destination, const BYTE instructions[], size_t
 
 void Mem::restoreAllPatches()
 {
-    // Iterate through all the patches and restore them
-    for (auto& patch : m_patches)
+    if (m_patches.empty()) return;
+
+    // Undo the patches newest first, with a single write pass
+    const auto patches = m_patches.takeAll();
+
+    std::vector<PatchSet::Write> writes;
+    writes.reserve(patches.size());
+    for (const auto& patch : patches)
+        writes.push_back({patch.begin(), patch.originalBytes.data(), patch.originalBytes.size()});
+    PatchSet::writeAll(writes);
+
+    // Free the trampolines only once nothing jumps to them anymore
+    for (const auto& patch : patches)
     {
-        if (patch.second.hasTrampoline) removeTrampoline(reinterpret_cast<uintptr_t>(patch.second.address));
-        else restore(reinterpret_cast<uintptr_t>(patch.second.address));
+        if (patch.hasTrampoline) NearbyArena::getInstance().free(patch.trampolineDestination);
     }
 }
+
+const Mem::PatchInfo* Mem::findPatch(uintptr_t address)
+{
+    return m_patches.find(address);
+}
+
+std::optional<FunctionIndex::Function> Mem::findFunction(uintptr_t address)
+{
+    const auto index = FunctionIndex::forAddress(address);
+    return index ? index->find(address) : std::nullopt;
+}
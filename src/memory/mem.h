@@ -1,5 +1,13 @@
 ﻿#pragma once
 
+#include "function_index.h"
+#include "multi_scanner.h"
+#include "patch_index.h"
+#include "patch_set.h"
+#include "pe_image.h"
+#include "scanner.h"
+#include "signature.h"
+
 #define AUTO_ASSEMBLE_TRAMPOLINE(ADDRESS, TRAMPOLINE_LENGTH, INSTRUCTIONS) \
 do { \
 auto allocMemory = MemoryUtils::AllocateNearbyMemory(ADDRESS, sizeof(INSTRUCTIONS) + 14); \
@@ -14,37 +22,77 @@ public:
     static void patch(uintptr_t address, const char* bytes);
 
     template <size_t N>
-    static void patch(uintptr_t address, const BYTE (&bytes)[N]);
+    static void patch(uintptr_t address, const uint8_t (&bytes)[N]);
 
     static void nop(uintptr_t address, size_t len);
     static void restore(uintptr_t address);
     static void restore(std::initializer_list<uintptr_t> addresses);
 
-    static uintptr_t patternScan(uintptr_t module, const char* signature);
+    // Code signatures only need to look at executable sections, pass SectionKind::Data for globals/strings
+    static uintptr_t patternScan(uintptr_t module, const char* signature, SectionKind kind = SectionKind::Code);
+    static uintptr_t patternScan(uintptr_t module, const Signature& signature, SectionKind kind = SectionKind::Code);
+
+    // Signature literal ("48 8B ? ?"_sig), parsed at compile time
+    template <size_t N>
+    static uintptr_t patternScan(uintptr_t module, const StaticSignature<N>& signature,
+                                 SectionKind kind = SectionKind::Code);
 
+    // Every match in the module, found lazily as the range is iterated. Stop early with a break or
+    // std::views::take, or call toVector() to collect them all.
+    static MatchRange<Signature> patternScanAll(uintptr_t module, const char* signature,
+                                                SectionKind kind = SectionKind::Code);
+    static MatchRange<Signature> patternScanAll(uintptr_t module, const Signature& signature,
+                                                SectionKind kind = SectionKind::Code);
+
+    template <size_t N>
+    static MatchRange<StaticSignature<N>> patternScanAll(uintptr_t module, const StaticSignature<N>& signature,
+                                                         SectionKind kind = SectionKind::Code);
+
+    // Resolves all signatures in one pass over the module. Results follow the scanner's signature order,
+    // an empty entry means the signature was not found.
+    static std::vector<std::vector<uintptr_t>> patternScanBatch(uintptr_t module, const MultiScanner& scanner,
+                                                                bool allMatches = false,
+                                                                SectionKind kind = SectionKind::Code);
+
+    // Executable memory within ±2GB of 'address', pooled with the other trampolines and stubs
     static void* allocateNearbyMemory(uintptr_t address, size_t size);
 
     static void createTrampoline(uintptr_t address, void* destination, size_t length);
     static void removeTrampoline(uintptr_t address);
-    static void writeInstructions(void* destination, const BYTE instructions[], size_t instructionLen,
+    static void writeInstructions(void* destination, const uint8_t instructions[], size_t instructionLen,
                                   uintptr_t retAddress);
 
     static void restoreAllPatches();
 
-    struct PatchInfo
-    {
-        void* address;
-        std::vector<BYTE> originalBytes;
-        bool hasTrampoline = false;
-        void* trampolineDestination = nullptr;
-    };
+    using PatchInfo = PatchIndex::Entry;
+
+    // Patch containing 'address', nullptr if it is not patched
+    static const PatchInfo* findPatch(uintptr_t address);
+
+    // Function containing 'address' in a loaded module, from its exception directory
+    static std::optional<FunctionIndex::Function> findFunction(uintptr_t address);
 
 private:
-    static std::unordered_map<void*, PatchInfo> m_patches;
+    friend class PatchSet;
+
+    static PatchIndex m_patches;
 };
 
 template <size_t N>
-static void patch(uintptr_t address, const BYTE (&bytes)[N])
+void Mem::patch(uintptr_t address, const uint8_t (&bytes)[N])
+{
+    patch(reinterpret_cast<void*>(address), reinterpret_cast<const char*>(bytes), N);
+}
+
+template <size_t N>
+uintptr_t Mem::patternScan(uintptr_t module, const StaticSignature<N>& signature, SectionKind kind)
+{
+    return Scanner::scanModule(module, signature, kind);
+}
+
+template <size_t N>
+MatchRange<StaticSignature<N>> Mem::patternScanAll(uintptr_t module, const StaticSignature<N>& signature,
+                                                   SectionKind kind)
 {
-    PatchBytes(reinterpret_cast<void*>(address), bytes, N);
+    return Scanner::scanModuleAll(module, signature, kind);
 }
@@ -0,0 +1,264 @@
+﻿#include "pch.h"
+#include "mid_hook.h"
+
+#include "code_relocator.h"
+#include "nearby_arena.h"
+#include "virtual_memory.h"
+
+#include <cstring>
+#include <vector>
+
+namespace
+{
+    // Register numbers as used in ModRM, also the slot of the register in MidHookContext
+    constexpr uint8_t RAX = 0;
+    constexpr uint8_t RCX = 1;
+    constexpr uint8_t RSP = 4;
+    constexpr uint8_t GPR_COUNT = 16;
+    constexpr uint8_t XMM_COUNT = 16;
+
+    // Stack frame below the aligned rsp: shadow space, the context and the saved-area pointer
+    constexpr int32_t SHADOW_SPACE = 32;
+    constexpr int32_t CONTEXT_OFFSET = SHADOW_SPACE;
+    constexpr int32_t SAVED_AREA_SLOT = CONTEXT_OFFSET + sizeof(MidHookContext);
+    constexpr int32_t FRAME_SIZE = SAVED_AREA_SLOT + 16;
+    static_assert(FRAME_SIZE % 16 == 0);
+
+    // Skipped below the interrupted rsp, the SysV red zone may hold live data
+    constexpr int32_t RED_ZONE = 128;
+
+    constexpr size_t MAX_RELOCATED_SIZE = CodeRelocator::maxSize(PatchSet::JUMP_SIZE);
+
+    constexpr size_t NEAR_JUMP_SIZE = 5;
+
+    class StubWriter
+    {
+    public:
+        std::vector<uint8_t>& code() { return m_code; }
+
+        void bytes(std::initializer_list<uint8_t> bytes) { m_code.insert(m_code.end(), bytes); }
+
+        template <typename T>
+        void value(T value)
+        {
+            const auto bytes = reinterpret_cast<const uint8_t*>(&value);
+            m_code.insert(m_code.end(), bytes, bytes + sizeof(value));
+        }
+
+        // mov [rsp+offset], reg / mov reg, [rsp+offset]
+        void storeGpr(uint8_t reg, int32_t offset) { rspAccess(0x89, reg, offset); }
+        void loadGpr(uint8_t reg, int32_t offset) { rspAccess(0x8B, reg, offset); }
+
+        // movdqu [rsp+offset], xmm / movdqu xmm, [rsp+offset]
+        void storeXmm(uint8_t reg, int32_t offset) { xmmAccess(0x7F, reg, offset); }
+        void loadXmm(uint8_t reg, int32_t offset) { xmmAccess(0x6F, reg, offset); }
+
+        // mov reg, imm64
+        void moveImmediate(uint8_t reg, uint64_t immediate)
+        {
+            bytes({static_cast<uint8_t>(0x48 | (reg >> 3)), static_cast<uint8_t>(0xB8 | (reg & 7))});
+            value(immediate);
+        }
+
+    private:
+        void rspAccess(uint8_t opcode, uint8_t reg, int32_t offset)
+        {
+            bytes({static_cast<uint8_t>(0x48 | ((reg >> 3) << 2)), opcode, static_cast<uint8_t>(0x84 | (reg & 7) << 3),
+                   0x24});
+            value(offset);
+        }
+
+        void xmmAccess(uint8_t opcode, uint8_t reg, int32_t offset)
+        {
+            bytes({0xF3});
+            if (reg >= 8) bytes({0x44});
+            bytes({0x0F, opcode, static_cast<uint8_t>(0x84 | (reg & 7) << 3), 0x24});
+            value(offset);
+        }
+
+        std::vector<uint8_t> m_code;
+    };
+
+    int32_t gprOffset(uint8_t reg)
+    {
+        return CONTEXT_OFFSET + reg * static_cast<int32_t>(sizeof(uint64_t));
+    }
+
+    int32_t xmmOffset(uint8_t reg)
+    {
+        return CONTEXT_OFFSET + static_cast<int32_t>(offsetof(MidHookContext, xmm)) + reg * 16;
+    }
+
+    // Everything up to the displaced instructions: save, call, restore
+    std::vector<uint8_t> buildPrologue(MidHook::Callback callback, void* userData)
+    {
+        StubWriter writer;
+
+        // lea rsp, [rsp-128]; pushfq; cld; push rax
+        writer.bytes({0x48, 0x8D, 0x64, 0x24, static_cast<uint8_t>(-RED_ZONE), 0x9C, 0xFC, 0x50});
+
+        // rax = saved area (rax, rflags), then align the stack for the call
+        // mov rax, rsp; and rsp, -16; sub rsp, FRAME_SIZE
+        writer.bytes({0x48, 0x89, 0xE0, 0x48, 0x83, 0xE4, 0xF0, 0x48, 0x81, 0xEC});
+        writer.value(FRAME_SIZE);
+        writer.storeGpr(RAX, SAVED_AREA_SLOT);
+
+        for (uint8_t reg = 0; reg < GPR_COUNT; ++reg)
+        {
+            if (reg != RAX && reg != RSP) writer.storeGpr(reg, gprOffset(reg));
+        }
+
+        // rcx is saved now and free as scratch
+        // mov rcx, [rax]; mov [context.rax], rcx
+        writer.bytes({0x48, 0x8B, 0x08});
+        writer.storeGpr(RCX, gprOffset(RAX));
+        // mov rcx, [rax+8]; mov [context.rflags], rcx
+        writer.bytes({0x48, 0x8B, 0x48, 0x08});
+        writer.storeGpr(RCX, CONTEXT_OFFSET + static_cast<int32_t>(offsetof(MidHookContext, rflags)));
+        // lea rcx, [rax+16+RED_ZONE]; mov [context.rsp], rcx
+        writer.bytes({0x48, 0x8D, 0x88});
+        writer.value<int32_t>(16 + RED_ZONE);
+        writer.storeGpr(RCX, gprOffset(RSP));
+
+        for (uint8_t reg = 0; reg < XMM_COUNT; ++reg) writer.storeXmm(reg, xmmOffset(reg));
+
+#ifdef _WIN32
+        // lea rcx, [rsp+CONTEXT_OFFSET]; mov rdx, userData
+        writer.bytes({0x48, 0x8D, 0x4C, 0x24, CONTEXT_OFFSET});
+        writer.moveImmediate(2, reinterpret_cast<uint64_t>(userData));
+#else
+        // lea rdi, [rsp+CONTEXT_OFFSET]; mov rsi, userData
+        writer.bytes({0x48, 0x8D, 0x7C, 0x24, CONTEXT_OFFSET});
+        writer.moveImmediate(6, reinterpret_cast<uint64_t>(userData));
+#endif
+        // mov rax, callback; call rax
+        writer.moveImmediate(RAX, reinterpret_cast<uint64_t>(callback));
+        writer.bytes({0xFF, 0xD0});
+
+        for (uint8_t reg = 0; reg < XMM_COUNT; ++reg) writer.loadXmm(reg, xmmOffset(reg));
+
+        // rax and rflags go back through the saved area, popped on the way out
+        writer.loadGpr(RAX, SAVED_AREA_SLOT);
+        writer.loadGpr(RCX, gprOffset(RAX));
+        writer.bytes({0x48, 0x89, 0x08}); // mov [rax], rcx
+        writer.loadGpr(RCX, CONTEXT_OFFSET + static_cast<int32_t>(offsetof(MidHookContext, rflags)));
+        writer.bytes({0x48, 0x89, 0x48, 0x08}); // mov [rax+8], rcx
+
+        for (uint8_t reg = 0; reg < GPR_COUNT; ++reg)
+        {
+            if (reg != RAX && reg != RSP) writer.loadGpr(reg, gprOffset(reg));
+        }
+
+        // mov rsp, rax; pop rax; popfq; lea rsp, [rsp+128]
+        writer.bytes({0x48, 0x89, 0xC4, 0x58, 0x9D, 0x48, 0x8D, 0xA4, 0x24});
+        writer.value<int32_t>(RED_ZONE);
+
+        return std::move(writer.code());
+    }
+}
+
+MidHook::~MidHook()
+{
+    remove();
+}
+
+bool MidHook::install(uintptr_t address, Callback callback, void* userData)
+{
+    if (m_stub)
+    {
+        LOG_ERROR("Mid hook at {:#x} is already installed", m_address);
+        return false;
+    }
+
+    if (!address || !callback) return false;
+
+    const auto prologue = buildPrologue(callback, userData);
+    const auto stubSize = prologue.size() + MAX_RELOCATED_SIZE + CodeRelocator::ABSOLUTE_JUMP_SIZE;
+
+    const auto stub = NearbyArena::getInstance().allocate(address, stubSize);
+    if (!stub) return false;
+
+    // A rel32 jump displaces fewer instructions, the absolute one is only needed if the arena fell back
+    // to memory out of reach
+    const auto stubAddress = reinterpret_cast<uintptr_t>(stub);
+    const auto distance = static_cast<int64_t>(stubAddress - (address + NEAR_JUMP_SIZE));
+    const bool nearJump = distance >= INT32_MIN && distance <= INT32_MAX;
+    const auto jumpSize = nearJump ? NEAR_JUMP_SIZE : PatchSet::JUMP_SIZE;
+
+    auto relocated = CodeRelocator::relocate(address, jumpSize, stubAddress + prologue.size());
+    if (!relocated || relocated->code.size() > MAX_RELOCATED_SIZE)
+    {
+        LOG_ERROR("Failed to relocate the instructions at {:#x} for a mid hook", address);
+        NearbyArena::getInstance().free(stub);
+        return false;
+    }
+
+    std::vector<uint8_t> code = prologue;
+    code.insert(code.end(), relocated->code.begin(), relocated->code.end());
+    if (relocated->fallsThrough) CodeRelocator::appendJump(code, address + relocated->sourceLength);
+
+    memcpy(stub, code.data(), code.size());
+    VirtualMemory::flushInstructionCache(stubAddress, code.size());
+
+    // The jump to the stub, nops up to the next instruction boundary
+    std::vector<uint8_t> site;
+    if (nearJump)
+    {
+        const auto rel = static_cast<int32_t>(distance);
+        site.resize(NEAR_JUMP_SIZE);
+        site[0] = 0xE9;
+        memcpy(&site[1], &rel, sizeof(rel));
+    }
+    else
+    {
+        CodeRelocator::appendJump(site, stubAddress);
+    }
+    site.resize(relocated->sourceLength, 0x90);
+
+    m_patch = PatchSet();
+    m_patch.patch(address, site.data(), site.size());
+    if (!m_patch.commit())
+    {
+        LOG_ERROR("Failed to write mid hook jump at {:#x}", address);
+        NearbyArena::getInstance().free(stub);
+        return false;
+    }
+
+    m_address = address;
+    m_stub = stub;
+    m_displacedLength = relocated->sourceLength;
+
+    LOG_DEBUG("Mid hook at {:#x} -> stub {:p} ({} bytes displaced)", address, stub, m_displacedLength);
+    return true;
+}
+
+bool MidHook::install(uintptr_t address, std::function<void(MidHookContext&)> callback)
+{
+    if (!callback) return false;
+
+    // Owned on the heap, the stub keeps a pointer to it
+    auto function = std::make_unique<std::function<void(MidHookContext&)>>(std::move(callback));
+    if (!install(address, &MidHook::invokeFunction, function.get())) return false;
+
+    m_function = std::move(function);
+    return true;
+}
+
+void MidHook::remove()
+{
+    if (!m_stub) return;
+
+    // Nothing jumps to the stub once the original bytes are back
+    m_patch.rollback();
+    NearbyArena::getInstance().free(m_stub);
+
+    m_stub = nullptr;
+    m_address = 0;
+    m_displacedLength = 0;
+    m_function.reset();
+}
+
+void MidHook::invokeFunction(MidHookContext& context, void* userData)
+{
+    (*static_cast<std::function<void(MidHookContext&)>*>(userData))(context);
+}
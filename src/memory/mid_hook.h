@@ -0,0 +1,71 @@
+﻿#pragma once
+
+#include "patch_set.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+// Registers at the hooked instruction. Changes made by the callback are written back before the
+// displaced instructions run, except rsp which is read-only.
+struct MidHookContext
+{
+    uint64_t rax, rcx, rdx, rbx, rsp, rbp, rsi, rdi;
+    uint64_t r8, r9, r10, r11, r12, r13, r14, r15;
+    uint64_t rflags;
+    uint64_t reserved;
+
+    union alignas(16) Xmm
+    {
+        float f32[4];
+        double f64[2];
+        uint32_t u32[4];
+        uint64_t u64[2];
+    } xmm[16];
+};
+
+static_assert(offsetof(MidHookContext, rflags) == 128);
+static_assert(offsetof(MidHookContext, xmm) == 144);
+static_assert(sizeof(MidHookContext) == 400);
+
+// Hook at any instruction boundary, not just a function entry. The site is replaced with a jump to a stub
+// from the NearbyArena that saves all general purpose and xmm registers into a MidHookContext, calls the
+// callback, restores the (possibly modified) registers, runs the displaced instructions and jumps back.
+// The displaced instructions are relocated with CodeRelocator, so RIP-relative operands and branches
+// keep working.
+//
+//   MidHook hook;
+//   hook.install(address, [](MidHookContext& context) { context.rax = 1; });
+class MidHook
+{
+public:
+    using Callback = void(*)(MidHookContext& context, void* userData);
+
+    MidHook() = default;
+    ~MidHook();
+
+    MidHook(const MidHook&) = delete;
+    MidHook& operator=(const MidHook&) = delete;
+
+    bool install(uintptr_t address, Callback callback, void* userData = nullptr);
+    bool install(uintptr_t address, std::function<void(MidHookContext&)> callback);
+
+    // Restores the original bytes and frees the stub. No thread may be inside the stub at that point.
+    void remove();
+
+    _NODISCARD bool isInstalled() const { return m_stub != nullptr; }
+    _NODISCARD uintptr_t address() const { return m_address; }
+
+    // Bytes at the site that were replaced, whole instructions
+    _NODISCARD size_t displacedLength() const { return m_displacedLength; }
+
+private:
+    static void invokeFunction(MidHookContext& context, void* userData);
+
+    uintptr_t m_address = 0;
+    void* m_stub = nullptr;
+    size_t m_displacedLength = 0;
+    std::unique_ptr<std::function<void(MidHookContext&)>> m_function;
+    PatchSet m_patch;
+};
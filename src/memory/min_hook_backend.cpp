@@ -0,0 +1,68 @@
+﻿#include "pch.h"
+#include "min_hook_backend.h"
+
+#include <MinHook.h>
+
+namespace
+{
+    bool check(MH_STATUS status, const char* action, void* target)
+    {
+        if (status == MH_OK) return true;
+
+        LOG_ERROR("MinHook failed to {} {:p}: {}", action, target, magic_enum::enum_name(status));
+        return false;
+    }
+}
+
+bool MinHookBackend::initialize()
+{
+    const auto status = MH_Initialize();
+    if (status == MH_OK) return true;
+
+    LOG_ERROR("Failed to initialize MinHook: {}", magic_enum::enum_name(status));
+    return false;
+}
+
+void MinHookBackend::uninitialize()
+{
+    MH_Uninitialize();
+}
+
+bool MinHookBackend::create(void* target, void* detour, void** original)
+{
+    return check(MH_CreateHook(target, detour, original), "create hook on", target);
+}
+
+bool MinHookBackend::remove(void* target)
+{
+    return check(MH_RemoveHook(target), "remove hook on", target);
+}
+
+bool MinHookBackend::enable(void* target)
+{
+    return check(MH_EnableHook(target), "enable hook on", target);
+}
+
+bool MinHookBackend::disable(void* target)
+{
+    return check(MH_DisableHook(target), "disable hook on", target);
+}
+
+bool MinHookBackend::queueEnable(void* target)
+{
+    return check(MH_QueueEnableHook(target), "queue enabling", target);
+}
+
+bool MinHookBackend::queueDisable(void* target)
+{
+    return check(MH_QueueDisableHook(target), "queue disabling", target);
+}
+
+bool MinHookBackend::applyQueued()
+{
+    const auto status = MH_ApplyQueued();
+    if (status == MH_OK) return true;
+
+    LOG_ERROR("MinHook failed to apply queued hooks: {}", magic_enum::enum_name(status));
+    return false;
+}
@@ -0,0 +1,24 @@
+﻿#pragma once
+
+#include "hook_backend.h"
+
+// HookBackend on top of MinHook, the default on Windows. MinHook suspends all other threads while it
+// writes, once per call or once per applied queue.
+class MinHookBackend final : public HookBackend
+{
+public:
+    _NODISCARD const char* name() const override { return "MinHook"; }
+
+    bool initialize() override;
+    void uninitialize() override;
+
+    bool create(void* target, void* detour, void** original) override;
+    bool remove(void* target) override;
+
+    bool enable(void* target) override;
+    bool disable(void* target) override;
+
+    bool queueEnable(void* target) override;
+    bool queueDisable(void* target) override;
+    bool applyQueued() override;
+};
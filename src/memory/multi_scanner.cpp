@@ -0,0 +1,195 @@
+﻿#include "pch.h"
+#include "multi_scanner.h"
+
+#include "scanner.h"
+#include "utils/thread_pool.h"
+
+#include <queue>
+
+MultiScanner::MultiScanner(std::vector<Signature> signatures)
+    : m_signatures(std::move(signatures))
+{
+    build();
+}
+
+int32_t MultiScanner::addState()
+{
+    const auto state = static_cast<int32_t>(m_outputHead.size());
+    m_transitions.resize(m_transitions.size() + 256, -1);
+    m_outputHead.push_back(-1);
+    return state;
+}
+
+void MultiScanner::build()
+{
+    m_segments.clear();
+    m_transitions.clear();
+    m_outputHead.clear();
+    m_outputs.clear();
+
+    addState();
+
+    for (uint32_t index = 0; index < m_signatures.size(); ++index)
+    {
+        const auto& sig = m_signatures[index];
+
+        // Longest run of fully known bytes
+        Segment best{0, 0};
+        for (size_t i = 0; i < sig.size();)
+        {
+            if (sig.mask()[i] != 0xFF)
+            {
+                ++i;
+                continue;
+            }
+
+            size_t j = i;
+            while (j < sig.size() && sig.mask()[j] == 0xFF) ++j;
+            if (j - i > best.length) best = {i, j - i};
+            i = j;
+        }
+        m_segments.push_back(best);
+
+        if (!sig.valid() || best.length == 0) continue;
+
+        int32_t state = 0;
+        for (size_t i = 0; i < best.length; ++i)
+        {
+            const auto byte = sig.bytes()[best.offset + i];
+            auto next = m_transitions[state * 256 + byte];
+            if (next < 0)
+            {
+                next = addState();
+                m_transitions[state * 256 + byte] = next;
+            }
+            state = next;
+        }
+
+        m_outputs.push_back({index, m_outputHead[state]});
+        m_outputHead[state] = static_cast<int32_t>(m_outputs.size() - 1);
+    }
+
+    // Breadth-first pass computing failure links, turning the trie into a full DFA and
+    // chaining each state's outputs onto those of its failure state
+    std::vector<int32_t> fail(m_outputHead.size(), 0);
+    std::queue<int32_t> queue;
+
+    for (int byte = 0; byte < 256; ++byte)
+    {
+        auto& next = m_transitions[byte];
+        if (next < 0)
+        {
+            next = 0;
+            continue;
+        }
+        fail[next] = 0;
+        queue.push(next);
+    }
+
+    while (!queue.empty())
+    {
+        const auto state = queue.front();
+        queue.pop();
+
+        // Append the failure state's outputs (already final, it is shallower) to our own chain
+        const auto inherited = m_outputHead[fail[state]];
+        if (m_outputHead[state] < 0)
+        {
+            m_outputHead[state] = inherited;
+        }
+        else
+        {
+            auto tail = m_outputHead[state];
+            while (m_outputs[tail].next >= 0) tail = m_outputs[tail].next;
+            m_outputs[tail].next = inherited;
+        }
+
+        for (int byte = 0; byte < 256; ++byte)
+        {
+            auto& next = m_transitions[state * 256 + byte];
+            if (next < 0)
+            {
+                next = m_transitions[fail[state] * 256 + byte];
+                continue;
+            }
+            fail[next] = m_transitions[fail[state] * 256 + byte];
+            queue.push(next);
+        }
+    }
+}
+
+std::vector<MultiScanner::Result> MultiScanner::scan(const uint8_t* begin, const uint8_t* end, const Mode mode) const
+{
+    std::vector<Result> results(m_signatures.size());
+    if (m_signatures.empty() || begin >= end) return results;
+
+    auto remaining = std::ranges::count_if(m_signatures, [](const Signature& sig) { return sig.valid(); });
+    if (remaining == 0) return results;
+
+    const auto transitions = m_transitions.data();
+    int32_t state = 0;
+
+    for (auto current = begin; current < end; ++current)
+    {
+        state = transitions[state * 256 + *current];
+
+        for (auto out = m_outputHead[state]; out >= 0; out = m_outputs[out].next)
+        {
+            const auto index = m_outputs[out].signature;
+            auto& result = results[index];
+            if (mode == Mode::FirstMatch && result.found()) continue;
+
+            const auto& sig = m_signatures[index];
+            const auto& segment = m_segments[index];
+
+            // The segment ends at 'current', work back to where the whole signature would start
+            const auto back = segment.offset + segment.length - 1;
+            if (static_cast<size_t>(current - begin) < back) continue;
+
+            const auto start = current - back;
+            if (static_cast<size_t>(end - start) < sig.size()) continue;
+            if (!sig.matches(start)) continue;
+
+            result.matches.push_back(start);
+            if (mode == Mode::FirstMatch && --remaining == 0) return results;
+        }
+    }
+
+    return results;
+}
+
+std::vector<MultiScanner::Result> MultiScanner::scan(const std::vector<PeImage::Range>& ranges, const Mode mode) const
+{
+    size_t longest = 1;
+    for (const auto& sig : m_signatures) longest = (std::max)(longest, sig.size());
+
+    const auto chunks = Scanner::splitChunks(ranges, longest - 1);
+    std::vector<std::vector<Result>> chunkResults(chunks.size());
+
+    ThreadPool::getInstance().parallelFor(chunks.size(), [&](size_t index)
+    {
+        const auto& chunk = chunks[index];
+        auto results = scan(chunk.begin, chunk.scanEnd, mode);
+
+        // Matches starting in the overlap belong to the next chunk
+        for (auto& result : results)
+        {
+            std::erase_if(result.matches, [&chunk](const uint8_t* match) { return match >= chunk.end; });
+        }
+        chunkResults[index] = std::move(results);
+    });
+
+    std::vector<Result> merged(m_signatures.size());
+    for (auto& results : chunkResults)
+    {
+        for (size_t i = 0; i < results.size(); ++i)
+        {
+            auto& target = merged[i].matches;
+            if (mode == Mode::FirstMatch && !target.empty()) continue;
+
+            auto& source = results[i].matches;
+            target.insert(target.end(), source.begin(), source.end());
+        }
+    }
+    return merged;
+}
@@ -0,0 +1,60 @@
+﻿#pragma once
+
+#include "pe_image.h"
+#include "signature.h"
+
+// Finds many signatures in a single pass. An Aho-Corasick automaton is built over the longest
+// non-wildcard run of every signature, and each hit is then verified against the full signature.
+class MultiScanner
+{
+public:
+    enum class Mode
+    {
+        FirstMatch,
+        AllMatches
+    };
+
+    struct Result
+    {
+        std::vector<const uint8_t*> matches;
+
+        _NODISCARD bool found() const { return !matches.empty(); }
+        _NODISCARD const uint8_t* first() const { return matches.empty() ? nullptr : matches.front(); }
+    };
+
+    MultiScanner() = default;
+    explicit MultiScanner(std::vector<Signature> signatures);
+
+    // Results are returned in the same order as the signatures were given
+    _NODISCARD std::vector<Result> scan(const uint8_t* begin, const uint8_t* end, Mode mode = Mode::FirstMatch) const;
+
+    // Chunked scan of several ranges on the thread pool, matches are reported in ascending order
+    _NODISCARD std::vector<Result> scan(const std::vector<PeImage::Range>& ranges, Mode mode = Mode::FirstMatch) const;
+
+    _NODISCARD size_t size() const { return m_signatures.size(); }
+    _NODISCARD const Signature& signature(size_t index) const { return m_signatures[index]; }
+
+private:
+    struct Segment
+    {
+        size_t offset; // start of the run inside the signature
+        size_t length;
+    };
+
+    struct Output
+    {
+        uint32_t signature;
+        int32_t next; // next output in the chain, -1 terminates
+    };
+
+    std::vector<Signature> m_signatures;
+    std::vector<Segment> m_segments;
+
+    // Dense transition table, 256 entries per state; state 0 is the root
+    std::vector<int32_t> m_transitions;
+    std::vector<int32_t> m_outputHead;
+    std::vector<Output> m_outputs;
+
+    void build();
+    int32_t addState();
+};
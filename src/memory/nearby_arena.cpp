@@ -0,0 +1,158 @@
+﻿#include "pch.h"
+#include "nearby_arena.h"
+
+#include "virtual_memory.h"
+
+NearbyArena& NearbyArena::getInstance()
+{
+    // Never destroyed: hooks may still point into the blocks while the process exits, and hooks in static
+    // storage (FunctionHook, the HookDispatcher registry) free their thunks from their own destructors
+    static const auto instance = new NearbyArena();
+    return *instance;
+}
+
+bool NearbyArena::Block::reaches(uintptr_t address) const
+{
+    // Every byte of the block must be in range, not just its start
+    const auto end = base + size;
+    const auto farthest = address > base ? address - base : end - address;
+    return farthest <= MAX_DISTANCE;
+}
+
+void* NearbyArena::allocate(uintptr_t address, size_t size)
+{
+    if (size == 0) return nullptr;
+    size = (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+
+    std::lock_guard lock(m_mutex);
+
+    for (auto& block : m_blocks)
+    {
+        if (!block.reaches(address)) continue;
+        if (const auto result = allocateFrom(block, size)) return result;
+    }
+
+    // No block in reach has room, reserve a new one for this window
+    const auto blockSize = (std::max)(BLOCK_SIZE, (size + BLOCK_SIZE - 1) & ~(BLOCK_SIZE - 1));
+    auto memory = VirtualMemory::allocateNear(address, blockSize, MAX_DISTANCE);
+    if (!memory)
+    {
+        LOG_WARN("No free memory within 2GB of {:#x}, allocating anywhere", address);
+        memory = VirtualMemory::allocate(blockSize);
+        if (!memory)
+        {
+            LOG_ERROR("Failed to allocate {} bytes of executable memory", blockSize);
+            return nullptr;
+        }
+    }
+
+    Block block;
+    block.base = reinterpret_cast<uintptr_t>(memory);
+    block.size = blockSize;
+
+    // Keep blocks sorted so blockOf() can binary search
+    const auto it = std::ranges::upper_bound(m_blocks, block.base, {}, &Block::base);
+    return allocateFrom(*m_blocks.insert(it, std::move(block)), size);
+}
+
+void* NearbyArena::allocateFrom(Block& block, size_t size)
+{
+    size_t offset = block.size;
+
+    // First fit from the free list, then the untouched tail
+    const auto free = std::ranges::find_if(block.freeSlots, [size](const FreeSlot& slot) { return slot.size >= size; });
+    if (free != block.freeSlots.end())
+    {
+        offset = free->offset;
+        free->offset += size;
+        free->size -= size;
+        if (free->size == 0) block.freeSlots.erase(free);
+    }
+    else if (block.size - block.used >= size)
+    {
+        offset = block.used;
+        block.used += size;
+    }
+    else
+    {
+        return nullptr;
+    }
+
+    const auto live = std::ranges::upper_bound(block.live, offset, {}, &std::pair<size_t, size_t>::first);
+    block.live.insert(live, {offset, size});
+    return reinterpret_cast<void*>(block.base + offset);
+}
+
+bool NearbyArena::free(void* address)
+{
+    std::lock_guard lock(m_mutex);
+
+    const auto block = blockOf(reinterpret_cast<uintptr_t>(address));
+    if (!block) return false;
+
+    const auto offset = reinterpret_cast<uintptr_t>(address) - block->base;
+    const auto live = std::ranges::lower_bound(block->live, offset, {}, &std::pair<size_t, size_t>::first);
+    if (live == block->live.end() || live->first != offset)
+    {
+        LOG_ERROR("NearbyArena: {} was not allocated from the arena", address);
+        return false;
+    }
+
+    FreeSlot freed{offset, live->second};
+    block->live.erase(live);
+
+    // Fill with int3 so a stale jump into a freed stub traps instead of running garbage
+    memset(address, 0xCC, freed.size);
+
+    // Insert sorted and coalesce with both neighbours
+    auto next = std::ranges::upper_bound(block->freeSlots, offset, {}, &FreeSlot::offset);
+    if (next != block->freeSlots.end() && freed.offset + freed.size == next->offset)
+    {
+        freed.size += next->size;
+        next = block->freeSlots.erase(next);
+    }
+    if (next != block->freeSlots.begin())
+    {
+        const auto previous = std::prev(next);
+        if (previous->offset + previous->size == freed.offset)
+        {
+            previous->size += freed.size;
+            freed = *previous;
+            next = block->freeSlots.erase(previous);
+        }
+    }
+
+    // A free slot touching the bump pointer just moves it back
+    if (freed.offset + freed.size == block->used) block->used = freed.offset;
+    else block->freeSlots.insert(next, freed);
+    return true;
+}
+
+bool NearbyArena::owns(const void* address) const
+{
+    std::lock_guard lock(m_mutex);
+    return const_cast<NearbyArena*>(this)->blockOf(reinterpret_cast<uintptr_t>(address)) != nullptr;
+}
+
+NearbyArena::Stats NearbyArena::getStats() const
+{
+    std::lock_guard lock(m_mutex);
+
+    Stats stats;
+    stats.blocks = m_blocks.size();
+    for (const auto& block : m_blocks)
+    {
+        stats.reserved += block.size;
+        for (const auto& [offset, size] : block.live) stats.allocated += size;
+    }
+    return stats;
+}
+
+NearbyArena::Block* NearbyArena::blockOf(uintptr_t address)
+{
+    const auto it = std::ranges::upper_bound(m_blocks, address, {}, &Block::base);
+    if (it == m_blocks.begin()) return nullptr;
+
+    const auto block = std::prev(it);
+    return address < block->base + block->size ? &*block : nullptr;
+}
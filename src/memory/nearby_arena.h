@@ -0,0 +1,66 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Pool for trampolines and small code stubs that must live within rel32 reach of the code they are
+// called from. Blocks are reserved once per ±2 GB window and carved up with a bump pointer, freed stubs
+// go to a per-block free list and are reused by later allocations.
+class NearbyArena
+{
+public:
+    static NearbyArena& getInstance();
+
+    // Executable memory within MAX_DISTANCE of 'address'. Falls back to memory anywhere (logging a
+    // warning) if nothing nearby is free, absolute jumps still work from there.
+    void* allocate(uintptr_t address, size_t size);
+
+    // Returns a stub to its block. Memory the arena does not own is ignored.
+    bool free(void* address);
+
+    _NODISCARD bool owns(const void* address) const;
+
+    struct Stats
+    {
+        size_t blocks = 0;
+        size_t reserved = 0;  // bytes reserved from the OS
+        size_t allocated = 0; // bytes handed out and not freed
+    };
+
+    _NODISCARD Stats getStats() const;
+
+    NearbyArena(const NearbyArena&) = delete;
+    NearbyArena& operator=(const NearbyArena&) = delete;
+
+    static constexpr size_t BLOCK_SIZE = 1 << 16;
+    static constexpr size_t ALIGNMENT = 16;
+    static constexpr size_t MAX_DISTANCE = 0x7FF00000; // ~2 GB, leaves room for the stub itself
+
+private:
+    NearbyArena() = default;
+    ~NearbyArena() = default;
+
+    struct FreeSlot
+    {
+        size_t offset;
+        size_t size;
+    };
+
+    struct Block
+    {
+        uintptr_t base;
+        size_t size;
+        size_t used = 0;                  // bump pointer
+        std::vector<FreeSlot> freeSlots;  // sorted by offset, coalesced
+        std::vector<std::pair<size_t, size_t>> live; // offset -> size of handed out stubs, sorted
+
+        _NODISCARD bool reaches(uintptr_t address) const;
+    };
+
+    void* allocateFrom(Block& block, size_t size);
+    Block* blockOf(uintptr_t address);
+
+    mutable std::mutex m_mutex;
+    std::vector<Block> m_blocks;
+};
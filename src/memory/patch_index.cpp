@@ -0,0 +1,91 @@
+﻿#include "pch.h"
+#include "patch_index.h"
+
+std::vector<PatchIndex::Entry>::iterator PatchIndex::lowerBound(uintptr_t address)
+{
+    return std::ranges::upper_bound(m_entries, address, {}, &Entry::end);
+}
+
+PatchIndex::Entry& PatchIndex::insert(uintptr_t address, const uint8_t* original, size_t length, bool* merged)
+{
+    const auto end = address + length;
+
+    // Entries overlapping [address, end) are contiguous in the sorted vector
+    const auto first = lowerBound(address);
+    auto last = first;
+    while (last != m_entries.end() && last->begin() < end) ++last;
+
+    if (merged) *merged = first != last;
+
+    Entry entry;
+    entry.sequence = m_nextSequence++;
+
+    if (first == last)
+    {
+        entry.address = reinterpret_cast<void*>(address);
+        entry.originalBytes.assign(original, original + length);
+        entry.owners.push_back(entry.sequence);
+        return *m_entries.insert(first, std::move(entry));
+    }
+
+    const auto begin = (std::min)(address, first->begin());
+    const auto mergedEnd = (std::max)(end, std::prev(last)->end());
+
+    entry.address = reinterpret_cast<void*>(begin);
+    entry.originalBytes.resize(mergedEnd - begin);
+    memcpy(entry.originalBytes.data() + (address - begin), original, length);
+
+    // Bytes that were already patched keep the original recorded by the older patch
+    uint64_t trampolineSequence = 0;
+    for (auto it = first; it != last; ++it)
+    {
+        memcpy(entry.originalBytes.data() + (it->begin() - begin), it->originalBytes.data(), it->originalBytes.size());
+        entry.owners.insert(entry.owners.end(), it->owners.begin(), it->owners.end());
+
+        if (!it->hasTrampoline) continue;
+        if (entry.hasTrampoline)
+        {
+            LOG_WARN("Merging patches with two trampolines at {:#x}, keeping the newest", it->begin());
+            if (it->sequence < trampolineSequence) continue;
+        }
+
+        entry.hasTrampoline = true;
+        entry.trampolineDestination = it->trampolineDestination;
+        trampolineSequence = it->sequence;
+    }
+
+    std::ranges::sort(entry.owners);
+    entry.owners.push_back(entry.sequence);
+
+    const auto position = m_entries.erase(first, last);
+    return *m_entries.insert(position, std::move(entry));
+}
+
+PatchIndex::Entry* PatchIndex::find(uintptr_t address)
+{
+    const auto it = lowerBound(address);
+    return it != m_entries.end() && it->begin() <= address ? &*it : nullptr;
+}
+
+const PatchIndex::Entry* PatchIndex::find(uintptr_t address) const
+{
+    return const_cast<PatchIndex*>(this)->find(address);
+}
+
+bool PatchIndex::erase(uintptr_t address)
+{
+    const auto it = lowerBound(address);
+    if (it == m_entries.end() || it->begin() > address) return false;
+
+    m_entries.erase(it);
+    return true;
+}
+
+std::vector<PatchIndex::Entry> PatchIndex::takeAll()
+{
+    auto entries = std::move(m_entries);
+    m_entries.clear();
+
+    std::ranges::sort(entries, std::greater{}, &Entry::sequence);
+    return entries;
+}
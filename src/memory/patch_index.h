@@ -0,0 +1,52 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Bookkeeping for applied patches: disjoint [begin, end) ranges kept sorted by address, so any address
+// inside a patch is found with a binary search. A patch that overlaps existing ones is merged with them,
+// keeping the oldest original bytes for every address so a restore always brings back the unpatched code.
+class PatchIndex
+{
+public:
+    struct Entry
+    {
+        void* address;
+        std::vector<uint8_t> originalBytes;
+        bool hasTrampoline = false;
+        void* trampolineDestination = nullptr;
+        uint64_t sequence = 0; // order in which patches were applied, merged entries take the latest
+        std::vector<uint64_t> owners{}; // sequences of the patches folded into this entry, oldest first
+
+        _NODISCARD uintptr_t begin() const { return reinterpret_cast<uintptr_t>(address); }
+        _NODISCARD uintptr_t end() const { return begin() + originalBytes.size(); }
+    };
+
+    // Records a patch over [address, address + length), 'original' being the bytes it replaced.
+    // 'merged' is set when existing entries were folded into the returned one. The returned entry's
+    // sequence identifies the new patch among its owners.
+    Entry& insert(uintptr_t address, const uint8_t* original, size_t length, bool* merged = nullptr);
+
+    // Entry containing 'address', nullptr if it is not patched
+    _NODISCARD Entry* find(uintptr_t address);
+    _NODISCARD const Entry* find(uintptr_t address) const;
+
+    // Removes the entry containing 'address'
+    bool erase(uintptr_t address);
+
+    // All entries, most recently applied first, leaving the index empty
+    std::vector<Entry> takeAll();
+
+    _NODISCARD size_t size() const { return m_entries.size(); }
+    _NODISCARD bool empty() const { return m_entries.empty(); }
+
+    _NODISCARD auto begin() const { return m_entries.begin(); }
+    _NODISCARD auto end() const { return m_entries.end(); }
+
+private:
+    // First entry ending after 'address'
+    _NODISCARD std::vector<Entry>::iterator lowerBound(uintptr_t address);
+
+    std::vector<Entry> m_entries;
+    uint64_t m_nextSequence = 0;
+};
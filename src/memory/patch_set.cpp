@@ -0,0 +1,210 @@
+﻿#include "pch.h"
+#include "patch_set.h"
+
+#include "mem.h"
+#include "virtual_memory.h"
+
+PatchSet& PatchSet::patch(uintptr_t address, const void* bytes, size_t length)
+{
+    if (!address || !bytes || length == 0)
+    {
+        LOG_ERROR("PatchSet: invalid patch at {:#x}", address);
+        m_valid = false;
+        return *this;
+    }
+
+    const auto data = static_cast<const uint8_t*>(bytes);
+    m_entries.push_back({address, std::vector<uint8_t>(data, data + length)});
+    return *this;
+}
+
+PatchSet& PatchSet::patch(uintptr_t address, std::initializer_list<uint8_t> bytes)
+{
+    return patch(address, bytes.begin(), bytes.size());
+}
+
+PatchSet& PatchSet::nop(uintptr_t address, size_t length)
+{
+    const std::vector<uint8_t> nops(length, 0x90);
+    return patch(address, nops.data(), nops.size());
+}
+
+PatchSet& PatchSet::jump(uintptr_t address, void* destination, size_t length)
+{
+    if (length < JUMP_SIZE)
+    {
+        LOG_ERROR("PatchSet: a jump needs {} bytes, only {} available at {:#x}", JUMP_SIZE, length, address);
+        m_valid = false;
+        return *this;
+    }
+
+    // jmp [rip+0] followed by the absolute destination
+    std::vector<uint8_t> bytes(length, 0x90);
+    bytes[0] = 0xFF;
+    bytes[1] = 0x25;
+    memset(&bytes[2], 0, 4);
+    memcpy(&bytes[6], &destination, 8);
+
+    patch(address, bytes.data(), bytes.size());
+    if (m_valid) m_entries.back().trampolineDestination = destination;
+    return *this;
+}
+
+bool PatchSet::commit()
+{
+    if (m_committed || !m_valid || m_entries.empty()) return false;
+
+    std::ranges::stable_sort(m_entries, {}, &Entry::address);
+    for (size_t i = 1; i < m_entries.size(); ++i)
+    {
+        const auto& previous = m_entries[i - 1];
+        if (previous.address + previous.bytes.size() > m_entries[i].address)
+        {
+            LOG_ERROR("PatchSet: patches at {:#x} and {:#x} overlap", previous.address, m_entries[i].address);
+            return false;
+        }
+    }
+
+    std::vector<Write> writes;
+    writes.reserve(m_entries.size());
+    for (auto& entry : m_entries)
+    {
+        entry.original.assign(reinterpret_cast<const uint8_t*>(entry.address),
+                              reinterpret_cast<const uint8_t*>(entry.address) + entry.bytes.size());
+        writes.push_back({entry.address, entry.bytes.data(), entry.bytes.size()});
+    }
+
+    if (!writeAll(writes)) return false;
+
+    for (auto& entry : m_entries)
+    {
+        // Overlapping an earlier patch merges with it, the oldest original bytes are kept
+        auto& info = Mem::m_patches.insert(entry.address, entry.original.data(), entry.original.size());
+        entry.sequence = info.sequence;
+
+        entry.hadTrampoline = info.hasTrampoline;
+        entry.previousDestination = info.trampolineDestination;
+        if (entry.trampolineDestination)
+        {
+            info.hasTrampoline = true;
+            info.trampolineDestination = entry.trampolineDestination;
+        }
+    }
+
+    m_committed = true;
+    return true;
+}
+
+bool PatchSet::rollback()
+{
+    if (!m_committed) return false;
+
+    const auto ownedBySet = [this](uint64_t sequence)
+    {
+        return std::ranges::any_of(m_entries, [sequence](const Entry& entry) { return entry.sequence == sequence; });
+    };
+
+    // Restoring under a later patch that was merged with ours would undo that one too, and erasing the
+    // merged entry would lose the original bytes it still needs
+    for (const auto& entry : m_entries)
+    {
+        const auto info = Mem::m_patches.find(entry.address);
+        if (!info) continue;
+
+        for (const auto owner : info->owners)
+        {
+            if (owner > entry.sequence && !ownedBySet(owner))
+            {
+                LOG_ERROR("PatchSet: {:#x} was patched again after this set, roll that patch back first",
+                          entry.address);
+                return false;
+            }
+        }
+    }
+
+    std::vector<Write> writes;
+    writes.reserve(m_entries.size());
+    for (auto it = m_entries.rbegin(); it != m_entries.rend(); ++it)
+        writes.push_back({it->address, it->original.data(), it->original.size()});
+
+    if (!writeAll(writes)) return false;
+
+    for (auto it = m_entries.rbegin(); it != m_entries.rend(); ++it)
+    {
+        const auto info = Mem::m_patches.find(it->address);
+        if (!info) continue;
+
+        std::erase(info->owners, it->sequence);
+        if (info->owners.empty())
+        {
+            Mem::m_patches.erase(it->address);
+            continue;
+        }
+
+        // Merged into an older patch, which stays recorded with its original bytes
+        info->hasTrampoline = it->hadTrampoline;
+        info->trampolineDestination = it->previousDestination;
+    }
+
+    m_committed = false;
+    return true;
+}
+
+bool PatchSet::writeAll(const std::vector<Write>& writes)
+{
+    if (writes.empty()) return true;
+
+    // Page spans touched by the writes, merged into contiguous runs
+    std::vector<std::pair<uintptr_t, uintptr_t>> runs;
+    runs.reserve(writes.size());
+    for (const auto& write : writes)
+        runs.emplace_back(VirtualMemory::pageFloor(write.address), VirtualMemory::pageCeil(write.address + write.length));
+
+    std::ranges::sort(runs);
+    size_t merged = 0;
+    for (size_t i = 1; i < runs.size(); ++i)
+    {
+        if (runs[i].first <= runs[merged].second) runs[merged].second = (std::max)(runs[merged].second, runs[i].second);
+        else runs[++merged] = runs[i];
+    }
+    runs.resize(merged + 1);
+
+    // A run can cross regions with different protections (.text next to .rdata), each keeps its own
+    std::vector<VirtualMemory::Region> changed;
+    const auto restoreProtection = [&changed]
+    {
+        for (const auto& region : changed)
+            VirtualMemory::protect(region.begin, region.end - region.begin, region.protection);
+    };
+
+    for (const auto& [begin, end] : runs)
+    {
+        for (auto current = begin; current < end;)
+        {
+            VirtualMemory::Region region;
+            if (!VirtualMemory::query(current, region))
+            {
+                LOG_ERROR("PatchSet: {:#x} is not mapped", current);
+                restoreProtection();
+                return false;
+            }
+
+            const auto chunkEnd = (std::min)(end, region.end);
+            if (!VirtualMemory::makeWritable(current, chunkEnd - current))
+            {
+                LOG_ERROR("PatchSet: failed to make {:#x} writable", current);
+                restoreProtection();
+                return false;
+            }
+
+            changed.push_back({current, chunkEnd, region.protection});
+            current = chunkEnd;
+        }
+    }
+
+    for (const auto& write : writes) memcpy(reinterpret_cast<void*>(write.address), write.bytes, write.length);
+
+    restoreProtection();
+    for (const auto& write : writes) VirtualMemory::flushInstructionCache(write.address, write.length);
+    return true;
+}
@@ -0,0 +1,69 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+
+// Collects byte patches and applies them as one unit: pages are made writable once, every patch is
+// written, then the original protection comes back and the instruction cache is flushed. Either the
+// whole set is applied or nothing is, and a committed set can be rolled back as a whole.
+//
+//   PatchSet set;
+//   set.nop(address, 5).patch(other, {0xB0, 0x01, 0xC3});
+//   if (!set.commit()) return;
+//   ...
+//   set.rollback();
+//
+// Committed patches are registered with Mem, so Mem::restore and Mem::restoreAllPatches still see them.
+class PatchSet
+{
+public:
+    PatchSet& patch(uintptr_t address, const void* bytes, size_t length);
+    PatchSet& patch(uintptr_t address, std::initializer_list<uint8_t> bytes);
+    PatchSet& nop(uintptr_t address, size_t length);
+
+    // jmp [rip+0] to 'destination', padded with nops up to 'length' (at least JUMP_SIZE bytes)
+    PatchSet& jump(uintptr_t address, void* destination, size_t length);
+
+    // Applies every patch. Fails without touching memory if patches overlap or a page can't be made
+    // writable.
+    bool commit();
+
+    // Restores the bytes the committed patches replaced, in reverse order. Refused while a patch applied
+    // later still overlaps one of them, that patch has to be restored or rolled back first.
+    bool rollback();
+
+    _NODISCARD size_t size() const { return m_entries.size(); }
+    _NODISCARD bool empty() const { return m_entries.empty(); }
+    _NODISCARD bool committed() const { return m_committed; }
+
+    struct Write
+    {
+        uintptr_t address;
+        const uint8_t* bytes;
+        size_t length;
+    };
+
+    // Writes all blocks with one protection change per run of pages. Also used by Mem for restores.
+    static bool writeAll(const std::vector<Write>& writes);
+
+    static constexpr size_t JUMP_SIZE = 14;
+
+private:
+    struct Entry
+    {
+        uintptr_t address = 0;
+        std::vector<uint8_t> bytes{};
+        std::vector<uint8_t> original{};
+        void* trampolineDestination = nullptr;
+
+        // State of Mem's bookkeeping before commit, for rollback
+        uint64_t sequence = 0; // owner id of this patch in Mem's entry
+        bool hadTrampoline = false;
+        void* previousDestination = nullptr;
+    };
+
+    std::vector<Entry> m_entries;
+    bool m_committed = false;
+    bool m_valid = true;
+};
@@ -0,0 +1,149 @@
+﻿#include "pch.h"
+#include "pe_file.h"
+
+#include "asm_resolver.h"
+#include "function_index.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+PeFile::FileView::FileView(const std::filesystem::path& path)
+{
+#ifdef _WIN32
+    const auto file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                  FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return;
+    m_file = file;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) return;
+
+    m_mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!m_mapping) return;
+
+    m_data = static_cast<const uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+    if (m_data) m_size = static_cast<size_t>(fileSize.QuadPart);
+#else
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return;
+
+    struct stat st{};
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+        void* mapped = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped != MAP_FAILED)
+        {
+            m_data = static_cast<const uint8_t*>(mapped);
+            m_size = static_cast<size_t>(st.st_size);
+        }
+    }
+
+    // The mapping stays valid after the descriptor is closed
+    ::close(fd);
+#endif
+}
+
+PeFile::FileView::~FileView()
+{
+#ifdef _WIN32
+    if (m_data) UnmapViewOfFile(m_data);
+    if (m_mapping) CloseHandle(m_mapping);
+    if (m_file) CloseHandle(m_file);
+#else
+    if (m_data) munmap(const_cast<uint8_t*>(m_data), m_size);
+#endif
+}
+
+PeFile::PeFile(std::filesystem::path path, std::vector<uint8_t> buffer, uint64_t preferredBase)
+    : m_path(std::move(path))
+    , m_buffer(std::move(buffer))
+    , m_preferredBase(preferredBase)
+    , m_image(reinterpret_cast<uintptr_t>(m_buffer.data()))
+{
+}
+
+PeFile::~PeFile()
+{
+    FunctionIndex::release(base());
+    AsmResolver::clearFollowCache(base(), base() + size());
+}
+
+std::unique_ptr<PeFile> PeFile::open(const std::filesystem::path& path)
+{
+    const FileView file(path);
+    if (!file.data())
+    {
+        LOG_ERROR("PeFile: failed to map {}", path.string());
+        return nullptr;
+    }
+
+    const auto data = file.data();
+    const auto fileSize = file.size();
+
+    // Validate everything against the file size before touching it, the input is untrusted
+    if (fileSize < sizeof(pe::DosHeader)) return nullptr;
+
+    const auto dosHeader = reinterpret_cast<const pe::DosHeader*>(data);
+    if (dosHeader->magic != pe::DOS_MAGIC || dosHeader->lfanew < 0 ||
+        static_cast<size_t>(dosHeader->lfanew) + sizeof(pe::NtHeaders64) > fileSize)
+    {
+        LOG_ERROR("PeFile: {} is not a PE file", path.string());
+        return nullptr;
+    }
+
+    const auto ntHeaders = reinterpret_cast<const pe::NtHeaders64*>(data + dosHeader->lfanew);
+    if (ntHeaders->signature != pe::NT_SIGNATURE || ntHeaders->optionalHeader.magic != pe::OPTIONAL_MAGIC_64)
+    {
+        LOG_ERROR("PeFile: {} is not a PE32+ image", path.string());
+        return nullptr;
+    }
+
+    const auto& optional = ntHeaders->optionalHeader;
+    const auto sectionTableOffset = static_cast<size_t>(dosHeader->lfanew) + offsetof(pe::NtHeaders64, optionalHeader)
+        + ntHeaders->fileHeader.sizeOfOptionalHeader;
+    const auto sectionCount = ntHeaders->fileHeader.numberOfSections;
+    const auto sectionTableEnd = sectionTableOffset + sectionCount * sizeof(pe::SectionHeader);
+
+    // PeImage reads the NT headers and the section table from the laid out buffer, which only holds
+    // sizeOfImage bytes with the headers in the first sizeOfHeaders
+    if (sectionTableEnd > fileSize || optional.sizeOfHeaders > optional.sizeOfImage ||
+        static_cast<size_t>(dosHeader->lfanew) + sizeof(pe::NtHeaders64) > optional.sizeOfHeaders ||
+        sectionTableEnd > optional.sizeOfHeaders)
+    {
+        LOG_ERROR("PeFile: {} has a malformed header", path.string());
+        return nullptr;
+    }
+
+    // Lay the image out like the loader would: headers at 0, each section at its RVA, the rest zeroed
+    std::vector<uint8_t> buffer(optional.sizeOfImage, 0);
+    memcpy(buffer.data(), data, (std::min)(static_cast<size_t>(optional.sizeOfHeaders), fileSize));
+
+    const auto sections = reinterpret_cast<const pe::SectionHeader*>(data + sectionTableOffset);
+    for (uint16_t i = 0; i < sectionCount; ++i)
+    {
+        const auto& section = sections[i];
+        if (section.sizeOfRawData == 0 || section.virtualAddress >= optional.sizeOfImage) continue;
+
+        // Raw data is file-aligned and may be larger than the section itself
+        size_t length = section.sizeOfRawData;
+        if (section.virtualSize) length = (std::min)(length, static_cast<size_t>(section.virtualSize));
+        length = (std::min)(length, static_cast<size_t>(optional.sizeOfImage - section.virtualAddress));
+
+        if (section.pointerToRawData >= fileSize) continue;
+        length = (std::min)(length, fileSize - section.pointerToRawData);
+
+        memcpy(buffer.data() + section.virtualAddress, data + section.pointerToRawData, length);
+    }
+
+    auto result = std::unique_ptr<PeFile>(new PeFile(path, std::move(buffer), optional.imageBase));
+    if (!result->m_image.valid())
+    {
+        LOG_ERROR("PeFile: failed to parse the laid out image of {}", path.string());
+        return nullptr;
+    }
+    return result;
+}
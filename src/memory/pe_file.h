@@ -0,0 +1,64 @@
+﻿#pragma once
+
+#include "pe_image.h"
+
+#include <filesystem>
+#include <memory>
+
+// A PE file loaded from disk without the Windows loader. The file is memory-mapped read-only and its
+// headers and sections are copied to their virtual addresses in a private buffer, so base() can be
+// used anywhere a module base is expected (Scanner::scanModule, AsmResolver, PeImage...).
+// Imports are not resolved and relocations are not applied; absolute pointers still refer to
+// preferredBase().
+class PeFile
+{
+public:
+    // Returns nullptr (and logs why) if the file can't be read or is not a valid PE32+ image
+    static std::unique_ptr<PeFile> open(const std::filesystem::path& path);
+
+    _NODISCARD uintptr_t base() const { return reinterpret_cast<uintptr_t>(m_buffer.data()); }
+    _NODISCARD size_t size() const { return m_buffer.size(); }
+    _NODISCARD const PeImage& image() const { return m_image; }
+    _NODISCARD const std::filesystem::path& path() const { return m_path; }
+    _NODISCARD uint64_t preferredBase() const { return m_preferredBase; }
+
+    _NODISCARD uintptr_t rvaToAddress(uint32_t rva) const { return base() + rva; }
+    _NODISCARD uint32_t addressToRva(uintptr_t address) const { return static_cast<uint32_t>(address - base()); }
+
+    // Drops the FunctionIndex and AsmResolver::follow() results cached for the buffer, whose addresses
+    // can be reused by the next allocation
+    ~PeFile();
+
+    PeFile(const PeFile&) = delete;
+    PeFile& operator=(const PeFile&) = delete;
+
+private:
+    PeFile(std::filesystem::path path, std::vector<uint8_t> buffer, uint64_t preferredBase);
+
+    // Read-only view of the raw file, unmapped when it goes out of scope
+    class FileView
+    {
+    public:
+        explicit FileView(const std::filesystem::path& path);
+        ~FileView();
+
+        FileView(const FileView&) = delete;
+        FileView& operator=(const FileView&) = delete;
+
+        _NODISCARD const uint8_t* data() const { return m_data; }
+        _NODISCARD size_t size() const { return m_size; }
+
+    private:
+        const uint8_t* m_data = nullptr;
+        size_t m_size = 0;
+#ifdef _WIN32
+        void* m_file = nullptr;
+        void* m_mapping = nullptr;
+#endif
+    };
+
+    std::filesystem::path m_path;
+    std::vector<uint8_t> m_buffer;
+    uint64_t m_preferredBase;
+    PeImage m_image;
+};
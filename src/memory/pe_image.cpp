@@ -0,0 +1,116 @@
+﻿#include "pch.h"
+#include "pe_image.h"
+
+PeImage::PeImage(uintptr_t base)
+    : m_base(base)
+{
+    if (!base) return;
+
+    const auto dosHeader = reinterpret_cast<const pe::DosHeader*>(base);
+    if (dosHeader->magic != pe::DOS_MAGIC || dosHeader->lfanew < 0) return;
+
+    m_ntHeaders = reinterpret_cast<const pe::NtHeaders64*>(base + dosHeader->lfanew);
+    if (m_ntHeaders->signature != pe::NT_SIGNATURE) return;
+    if (m_ntHeaders->optionalHeader.magic != pe::OPTIONAL_MAGIC_64) return;
+
+    const auto sizeOfImage = m_ntHeaders->optionalHeader.sizeOfImage;
+
+    // Section table follows the optional header (IMAGE_FIRST_SECTION). The headers and the table must lie
+    // inside the image, a PeFile buffer is exactly sizeOfImage bytes.
+    const auto sectionTableOffset = static_cast<uint64_t>(dosHeader->lfanew) +
+        offsetof(pe::NtHeaders64, optionalHeader) + m_ntHeaders->fileHeader.sizeOfOptionalHeader;
+    const auto sectionTableEnd = sectionTableOffset +
+        static_cast<uint64_t>(m_ntHeaders->fileHeader.numberOfSections) * sizeof(pe::SectionHeader);
+    if (static_cast<uint64_t>(dosHeader->lfanew) + sizeof(pe::NtHeaders64) > sizeOfImage ||
+        sectionTableEnd > sizeOfImage)
+        return;
+
+    m_sizeOfImage = sizeOfImage;
+    m_timeDateStamp = m_ntHeaders->fileHeader.timeDateStamp;
+
+    const auto sectionTable = reinterpret_cast<const pe::SectionHeader*>(base + sectionTableOffset);
+
+    m_sections.reserve(m_ntHeaders->fileHeader.numberOfSections);
+    for (uint16_t i = 0; i < m_ntHeaders->fileHeader.numberOfSections; ++i)
+    {
+        const auto& header = sectionTable[i];
+
+        Section section;
+        section.name.assign(header.name, strnlen(header.name, sizeof(header.name)));
+        section.rva = header.virtualAddress;
+        section.size = header.virtualSize ? header.virtualSize : header.sizeOfRawData;
+        section.characteristics = header.characteristics;
+
+        // Never hand out ranges past the end of the image
+        if (section.rva >= m_sizeOfImage) continue;
+        section.size = (std::min)(section.size, m_sizeOfImage - section.rva);
+
+        m_sections.push_back(std::move(section));
+    }
+
+    std::ranges::sort(m_sections, {}, &Section::rva);
+    m_valid = true;
+}
+
+pe::DataDirectory PeImage::directory(int index) const
+{
+    if (!m_valid || index < 0) return {0, 0};
+
+    const auto& optional = m_ntHeaders->optionalHeader;
+    if (static_cast<size_t>(index) >= std::size(optional.dataDirectory) ||
+        static_cast<uint32_t>(index) >= optional.numberOfRvaAndSizes)
+        return {0, 0};
+
+    // The entry has to be part of the optional header as declared, and what it points to part of the image
+    const auto entryEnd = offsetof(pe::OptionalHeader64, dataDirectory) + (index + 1) * sizeof(pe::DataDirectory);
+    if (entryEnd > m_ntHeaders->fileHeader.sizeOfOptionalHeader) return {0, 0};
+
+    const auto directory = optional.dataDirectory[index];
+    if (directory.virtualAddress > m_sizeOfImage || directory.size > m_sizeOfImage - directory.virtualAddress)
+        return {0, 0};
+
+    return directory;
+}
+
+std::vector<PeImage::Range> PeImage::ranges(SectionKind kind) const
+{
+    std::vector<Range> result;
+    if (!m_valid) return result;
+
+    if (kind == SectionKind::Any)
+    {
+        result.push_back({data(), data() + m_sizeOfImage});
+        return result;
+    }
+
+    for (const auto& section : m_sections)
+    {
+        if (!section.matches(kind) || section.size == 0) continue;
+
+        const auto begin = data() + section.rva;
+        const auto end = begin + section.size;
+
+        // Merge adjacent sections so signatures spanning the boundary are still found
+        if (!result.empty() && result.back().end == begin) result.back().end = end;
+        else result.push_back({begin, end});
+    }
+    return result;
+}
+
+const PeImage::Section* PeImage::sectionFromRva(uint32_t rva) const
+{
+    for (const auto& section : m_sections)
+    {
+        if (rva >= section.rva && rva < section.rva + section.size) return &section;
+    }
+    return nullptr;
+}
+
+const PeImage::Section* PeImage::findSection(std::string_view name) const
+{
+    for (const auto& section : m_sections)
+    {
+        if (section.name == name) return &section;
+    }
+    return nullptr;
+}
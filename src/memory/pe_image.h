@@ -0,0 +1,200 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Minimal PE32+ header definitions so image parsing does not depend on <Windows.h>
+namespace pe
+{
+#pragma pack(push, 1)
+    struct DosHeader
+    {
+        uint16_t magic;
+        uint16_t unused[29];
+        int32_t lfanew;
+    };
+
+    struct FileHeader
+    {
+        uint16_t machine;
+        uint16_t numberOfSections;
+        uint32_t timeDateStamp;
+        uint32_t pointerToSymbolTable;
+        uint32_t numberOfSymbols;
+        uint16_t sizeOfOptionalHeader;
+        uint16_t characteristics;
+    };
+
+    struct DataDirectory
+    {
+        uint32_t virtualAddress;
+        uint32_t size;
+    };
+
+    struct OptionalHeader64
+    {
+        uint16_t magic;
+        uint8_t majorLinkerVersion;
+        uint8_t minorLinkerVersion;
+        uint32_t sizeOfCode;
+        uint32_t sizeOfInitializedData;
+        uint32_t sizeOfUninitializedData;
+        uint32_t addressOfEntryPoint;
+        uint32_t baseOfCode;
+        uint64_t imageBase;
+        uint32_t sectionAlignment;
+        uint32_t fileAlignment;
+        uint16_t majorOperatingSystemVersion;
+        uint16_t minorOperatingSystemVersion;
+        uint16_t majorImageVersion;
+        uint16_t minorImageVersion;
+        uint16_t majorSubsystemVersion;
+        uint16_t minorSubsystemVersion;
+        uint32_t win32VersionValue;
+        uint32_t sizeOfImage;
+        uint32_t sizeOfHeaders;
+        uint32_t checkSum;
+        uint16_t subsystem;
+        uint16_t dllCharacteristics;
+        uint64_t sizeOfStackReserve;
+        uint64_t sizeOfStackCommit;
+        uint64_t sizeOfHeapReserve;
+        uint64_t sizeOfHeapCommit;
+        uint32_t loaderFlags;
+        uint32_t numberOfRvaAndSizes;
+        DataDirectory dataDirectory[16];
+    };
+
+    struct NtHeaders64
+    {
+        uint32_t signature;
+        FileHeader fileHeader;
+        OptionalHeader64 optionalHeader;
+    };
+
+    // .pdata entry, one per non-leaf function (IMAGE_RUNTIME_FUNCTION_ENTRY)
+    struct RuntimeFunction
+    {
+        uint32_t beginAddress;
+        uint32_t endAddress;
+        uint32_t unwindInfoAddress;
+    };
+
+    // Fixed part of UNWIND_INFO, followed by countOfCodes 2 byte unwind codes (padded to an even count)
+    struct UnwindInfo
+    {
+        uint8_t versionAndFlags; // version in the low 3 bits, UNW_FLAG_* in the high 5
+        uint8_t sizeOfProlog;
+        uint8_t countOfCodes;
+        uint8_t frameRegisterAndOffset;
+    };
+
+    struct SectionHeader
+    {
+        char name[8];
+        uint32_t virtualSize;
+        uint32_t virtualAddress;
+        uint32_t sizeOfRawData;
+        uint32_t pointerToRawData;
+        uint32_t pointerToRelocations;
+        uint32_t pointerToLinenumbers;
+        uint16_t numberOfRelocations;
+        uint16_t numberOfLinenumbers;
+        uint32_t characteristics;
+    };
+#pragma pack(pop)
+
+    constexpr uint16_t DOS_MAGIC = 0x5A4D; // MZ
+    constexpr uint32_t NT_SIGNATURE = 0x00004550; // PE\0\0
+    constexpr uint16_t OPTIONAL_MAGIC_64 = 0x20B;
+
+    constexpr uint32_t SCN_CNT_CODE = 0x00000020;
+    constexpr uint32_t SCN_CNT_INITIALIZED_DATA = 0x00000040;
+    constexpr uint32_t SCN_MEM_DISCARDABLE = 0x02000000;
+    constexpr uint32_t SCN_MEM_EXECUTE = 0x20000000;
+    constexpr uint32_t SCN_MEM_READ = 0x40000000;
+    constexpr uint32_t SCN_MEM_WRITE = 0x80000000;
+
+    constexpr int DIRECTORY_EXCEPTION = 3;
+
+    // The unwind codes are followed by the RUNTIME_FUNCTION of the part this one continues
+    constexpr uint8_t UNW_FLAG_CHAININFO = 0x4;
+}
+
+// Which part of an image a scan should cover
+enum class SectionKind
+{
+    Code, // executable sections
+    Data, // initialized, non-executable, non-discardable sections (.rdata, .data)
+    Any   // the whole image, headers included
+};
+
+// View over a PE image laid out at its virtual addresses (a module mapped by the loader, or a
+// buffer prepared the same way). All offsets are RVAs relative to base().
+class PeImage
+{
+public:
+    struct Section
+    {
+        std::string name;
+        uint32_t rva;
+        uint32_t size;
+        uint32_t characteristics;
+
+        _NODISCARD bool isExecutable() const
+        {
+            return (characteristics & (pe::SCN_MEM_EXECUTE | pe::SCN_CNT_CODE)) != 0;
+        }
+
+        _NODISCARD bool isData() const
+        {
+            return !isExecutable() && (characteristics & pe::SCN_CNT_INITIALIZED_DATA) &&
+                !(characteristics & pe::SCN_MEM_DISCARDABLE);
+        }
+
+        _NODISCARD bool matches(SectionKind kind) const
+        {
+            switch (kind)
+            {
+            case SectionKind::Code:
+                return isExecutable();
+            case SectionKind::Data:
+                return isData();
+            case SectionKind::Any:
+            default:
+                return true;
+            }
+        }
+    };
+
+    struct Range
+    {
+        const uint8_t* begin;
+        const uint8_t* end;
+    };
+
+    explicit PeImage(uintptr_t base);
+
+    _NODISCARD bool valid() const { return m_valid; }
+    _NODISCARD uintptr_t base() const { return m_base; }
+    _NODISCARD const uint8_t* data() const { return reinterpret_cast<const uint8_t*>(m_base); }
+    _NODISCARD uint32_t sizeOfImage() const { return m_sizeOfImage; }
+    _NODISCARD uint32_t timeDateStamp() const { return m_timeDateStamp; }
+    _NODISCARD const std::vector<Section>& sections() const { return m_sections; }
+    _NODISCARD pe::DataDirectory directory(int index) const;
+
+    // Address ranges of all sections of the given kind, in ascending order
+    _NODISCARD std::vector<Range> ranges(SectionKind kind) const;
+
+    _NODISCARD const Section* sectionFromRva(uint32_t rva) const;
+    _NODISCARD const Section* findSection(std::string_view name) const;
+
+private:
+    uintptr_t m_base;
+    uint32_t m_sizeOfImage = 0;
+    uint32_t m_timeDateStamp = 0;
+    bool m_valid = false;
+    const pe::NtHeaders64* m_ntHeaders = nullptr;
+    std::vector<Section> m_sections;
+};
@@ -0,0 +1,163 @@
+﻿#include "pch.h"
+#include "scanner.h"
+
+#include "utils/thread_pool.h"
+
+namespace
+{
+    bool cpuHasAVX2()
+    {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7) return false;
+
+        // OSXSAVE + AVX, and the OS must save the YMM state
+        __cpuid(info, 1);
+        constexpr int osxsaveAvx = (1 << 27) | (1 << 28);
+        if ((info[2] & osxsaveAvx) != osxsaveAvx) return false;
+        if ((_xgetbv(0) & 0x6) != 0x6) return false;
+
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#else
+        return __builtin_cpu_supports("avx2");
+#endif
+    }
+}
+
+const uint8_t* Scanner::find(const uint8_t* begin, const uint8_t* end, const Signature& signature)
+{
+    return find(begin, end, signature, activeBackend());
+}
+
+const uint8_t* Scanner::find(const uint8_t* begin, const uint8_t* end, const Signature& signature,
+                             const Backend backend)
+{
+    if (!signature.valid() || begin >= end || static_cast<size_t>(end - begin) < signature.size()) return nullptr;
+
+    switch (backend)
+    {
+    case Backend::AVX2:
+        return scanner_detail::findAVX2(begin, end, signature);
+    case Backend::SSE2:
+        return scanner_detail::findSSE2(begin, end, signature);
+    case Backend::Scalar:
+    default:
+        return scanner_detail::findScalar(begin, end, signature);
+    }
+}
+
+const uint8_t* Scanner::findParallel(const std::vector<PeImage::Range>& ranges, const Signature& signature)
+{
+    if (!signature.valid()) return nullptr;
+
+    return findParallel(ranges, signature.size(), [&signature](const uint8_t* begin, const uint8_t* end)
+    {
+        return find(begin, end, signature);
+    });
+}
+
+const uint8_t* Scanner::findParallel(const std::vector<PeImage::Range>& ranges, size_t length, const FindFn& find)
+{
+    const auto chunks = splitChunks(ranges, length - 1);
+    std::vector<const uint8_t*> found(chunks.size(), nullptr);
+    std::atomic<size_t> firstChunk{chunks.size()};
+
+    ThreadPool::getInstance().parallelFor(chunks.size(), [&](size_t index)
+    {
+        // A lower chunk already has a match, nothing here can beat it
+        if (index > firstChunk.load(std::memory_order_relaxed)) return;
+
+        const auto& chunk = chunks[index];
+        const auto result = find(chunk.begin, chunk.scanEnd);
+        if (!result) return;
+
+        found[index] = result;
+        auto current = firstChunk.load();
+        while (index < current && !firstChunk.compare_exchange_weak(current, index))
+        {
+        }
+    });
+
+    const auto index = firstChunk.load();
+    return index < chunks.size() ? found[index] : nullptr;
+}
+
+uintptr_t Scanner::scanModule(uintptr_t module, const Signature& signature, SectionKind kind)
+{
+    const PeImage image(module);
+    if (!image.valid())
+    {
+        LOG_ERROR("scanModule: module at {:#x} is not a valid PE image", module);
+        return 0;
+    }
+
+    const auto result = findParallel(image.ranges(kind), signature);
+    return result ? module + (result - image.data()) : 0;
+}
+
+MatchRange<Signature> Scanner::findAll(std::vector<PeImage::Range> ranges, const Signature& signature)
+{
+    return MatchRange<Signature>(std::move(ranges), signature);
+}
+
+MatchRange<Signature> Scanner::scanModuleAll(uintptr_t module, const Signature& signature, SectionKind kind)
+{
+    const PeImage image(module);
+    if (!image.valid())
+    {
+        LOG_ERROR("scanModuleAll: module at {:#x} is not a valid PE image", module);
+        return findAll({}, signature);
+    }
+
+    return findAll(image.ranges(kind), signature);
+}
+
+std::vector<std::vector<uintptr_t>> Scanner::scanModule(uintptr_t module, const MultiScanner& scanner,
+                                                        MultiScanner::Mode mode, SectionKind kind)
+{
+    std::vector<std::vector<uintptr_t>> addresses(scanner.size());
+
+    const PeImage image(module);
+    if (!image.valid())
+    {
+        LOG_ERROR("scanModule: module at {:#x} is not a valid PE image", module);
+        return addresses;
+    }
+
+    const auto results = scanner.scan(image.ranges(kind), mode);
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        addresses[i].reserve(results[i].matches.size());
+        for (const auto match : results[i].matches) addresses[i].push_back(module + (match - image.data()));
+    }
+    return addresses;
+}
+
+std::vector<Scanner::Chunk> Scanner::splitChunks(const std::vector<PeImage::Range>& ranges, size_t overlap)
+{
+    std::vector<Chunk> chunks;
+    for (const auto& range : ranges)
+    {
+        for (auto current = range.begin; current < range.end; current += CHUNK_SIZE)
+        {
+            const auto end = static_cast<size_t>(range.end - current) > CHUNK_SIZE ? current + CHUNK_SIZE : range.end;
+            const auto scanEnd = static_cast<size_t>(range.end - end) > overlap ? end + overlap : range.end;
+            chunks.push_back({current, end, scanEnd});
+        }
+    }
+    return chunks;
+}
+
+Scanner::Backend Scanner::bestBackend()
+{
+    // SSE2 is part of the x64 baseline
+    return cpuHasAVX2() ? Backend::AVX2 : Backend::SSE2;
+}
+
+Scanner::Backend Scanner::activeBackend()
+{
+    static const Backend backend = bestBackend();
+    return backend;
+}
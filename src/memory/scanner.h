@@ -0,0 +1,237 @@
+﻿#pragma once
+
+#include "multi_scanner.h"
+#include "pe_image.h"
+#include "scanner_kernels.h"
+#include "signature.h"
+
+#include <functional>
+#include <ranges>
+
+template <typename Sig>
+class MatchRange;
+
+class Scanner
+{
+public:
+    enum class Backend
+    {
+        Scalar,
+        SSE2,
+        AVX2
+    };
+
+    // Returns the first match in [begin, end) or nullptr
+    static const uint8_t* find(const uint8_t* begin, const uint8_t* end, const Signature& signature);
+
+    // Forces a specific implementation, mainly for comparing backends against each other
+    static const uint8_t* find(const uint8_t* begin, const uint8_t* end, const Signature& signature,
+                               Backend backend);
+
+    // Compile-time signature, specialized on its length
+    template <size_t N>
+    static const uint8_t* find(const uint8_t* begin, const uint8_t* end, const StaticSignature<N>& signature);
+
+    // Scans the ranges in chunks on the thread pool, returns the lowest matching address or nullptr
+    static const uint8_t* findParallel(const std::vector<PeImage::Range>& ranges, const Signature& signature);
+
+    template <size_t N>
+    static const uint8_t* findParallel(const std::vector<PeImage::Range>& ranges,
+                                       const StaticSignature<N>& signature);
+
+    // Scans the sections of the PE image at 'module', either a module mapped by the loader or a
+    // PeFile::base(). Returns the absolute address of the first match or 0.
+    static uintptr_t scanModule(uintptr_t module, const Signature& signature, SectionKind kind = SectionKind::Code);
+
+    template <size_t N>
+    static uintptr_t scanModule(uintptr_t module, const StaticSignature<N>& signature,
+                                SectionKind kind = SectionKind::Code);
+
+    // Lazily yields every match in the ranges in ascending order, see MatchRange
+    static MatchRange<Signature> findAll(std::vector<PeImage::Range> ranges, const Signature& signature);
+
+    template <size_t N>
+    static MatchRange<StaticSignature<N>> findAll(std::vector<PeImage::Range> ranges,
+                                                  const StaticSignature<N>& signature);
+
+    // findAll() over the sections of the PE image at 'module'
+    static MatchRange<Signature> scanModuleAll(uintptr_t module, const Signature& signature,
+                                               SectionKind kind = SectionKind::Code);
+
+    template <size_t N>
+    static MatchRange<StaticSignature<N>> scanModuleAll(uintptr_t module, const StaticSignature<N>& signature,
+                                                        SectionKind kind = SectionKind::Code);
+
+    // One pass for all of the scanner's signatures, absolute addresses per signature (empty if not found)
+    static std::vector<std::vector<uintptr_t>> scanModule(uintptr_t module, const MultiScanner& scanner,
+                                                          MultiScanner::Mode mode = MultiScanner::Mode::FirstMatch,
+                                                          SectionKind kind = SectionKind::Code);
+
+    // Best backend supported by the current CPU
+    static Backend bestBackend();
+
+    // bestBackend(), evaluated once
+    static Backend activeBackend();
+
+    struct Chunk
+    {
+        const uint8_t* begin;
+        const uint8_t* end;     // matches must start before this
+        const uint8_t* scanEnd; // end extended by the overlap, clamped to the range
+    };
+
+    // Splits ranges into chunks that overlap by 'overlap' bytes so matches crossing a boundary are not lost
+    static std::vector<Chunk> splitChunks(const std::vector<PeImage::Range>& ranges, size_t overlap);
+
+    static constexpr size_t CHUNK_SIZE = 1 << 20;
+
+private:
+    using FindFn = std::function<const uint8_t*(const uint8_t*, const uint8_t*)>;
+
+    static const uint8_t* findParallel(const std::vector<PeImage::Range>& ranges, size_t length, const FindFn& find);
+};
+
+// Input range over all matches of a signature, found one at a time with Scanner::find. Each step resumes
+// right after the previous match, so iterating to the end is a single pass and stopping early skips the
+// rest of the scan. Works with range adaptors:
+//
+//   for (const auto address : Mem::patternScanAll(module, "E8 ? ? ? ? 48 8B D8"_sig) | std::views::take(4))
+//
+// Iterators point back into the range, so it must outlive them and not be moved once iteration started.
+template <typename Sig>
+class MatchRange : public std::ranges::view_interface<MatchRange<Sig>>
+{
+public:
+    class Iterator
+    {
+    public:
+        using value_type = uintptr_t;
+        using difference_type = ptrdiff_t;
+        using iterator_concept = std::input_iterator_tag;
+
+        Iterator() = default;
+        explicit Iterator(MatchRange* parent) : m_parent(parent) {}
+
+        uintptr_t operator*() const { return reinterpret_cast<uintptr_t>(m_parent->m_match); }
+
+        Iterator& operator++()
+        {
+            m_parent->advance();
+            return *this;
+        }
+
+        void operator++(int) { ++*this; }
+
+        friend bool operator==(const Iterator& it, std::default_sentinel_t) { return it.atEnd(); }
+
+    private:
+        bool atEnd() const { return !m_parent || !m_parent->m_match; }
+
+        MatchRange* m_parent = nullptr;
+    };
+
+    MatchRange(std::vector<PeImage::Range> ranges, Sig signature)
+        : m_ranges(std::move(ranges))
+        , m_signature(std::move(signature))
+    {
+    }
+
+    Iterator begin()
+    {
+        if (!m_started)
+        {
+            m_started = true;
+            advance();
+        }
+        return Iterator(this);
+    }
+
+    std::default_sentinel_t end() const { return std::default_sentinel; }
+
+    // Collects the remaining matches
+    std::vector<uintptr_t> toVector()
+    {
+        std::vector<uintptr_t> result;
+        for (const auto address : *this) result.push_back(address);
+        return result;
+    }
+
+private:
+    void advance()
+    {
+        while (m_rangeIndex < m_ranges.size())
+        {
+            const auto& range = m_ranges[m_rangeIndex];
+            if (!m_current) m_current = range.begin;
+
+            if (const auto match = Scanner::find(m_current, range.end, m_signature))
+            {
+                m_match = match;
+                m_current = match + 1;
+                return;
+            }
+
+            ++m_rangeIndex;
+            m_current = nullptr;
+        }
+        m_match = nullptr;
+    }
+
+    std::vector<PeImage::Range> m_ranges;
+    Sig m_signature;
+    size_t m_rangeIndex = 0;
+    const uint8_t* m_current = nullptr;
+    const uint8_t* m_match = nullptr;
+    bool m_started = false;
+};
+
+template <size_t N>
+MatchRange<StaticSignature<N>> Scanner::findAll(std::vector<PeImage::Range> ranges,
+                                                const StaticSignature<N>& signature)
+{
+    return MatchRange<StaticSignature<N>>(std::move(ranges), signature);
+}
+
+template <size_t N>
+MatchRange<StaticSignature<N>> Scanner::scanModuleAll(uintptr_t module, const StaticSignature<N>& signature,
+                                                      SectionKind kind)
+{
+    const PeImage image(module);
+    return findAll(image.valid() ? image.ranges(kind) : std::vector<PeImage::Range>{}, signature);
+}
+
+template <size_t N>
+const uint8_t* Scanner::find(const uint8_t* begin, const uint8_t* end, const StaticSignature<N>& signature)
+{
+    if (begin >= end || static_cast<size_t>(end - begin) < N) return nullptr;
+
+    switch (activeBackend())
+    {
+    case Backend::AVX2:
+        return scanner_detail::findAVX2(begin, end, signature);
+    case Backend::SSE2:
+        return scanner_detail::findSSE2(begin, end, signature);
+    case Backend::Scalar:
+    default:
+        return scanner_detail::findScalar(begin, end, signature);
+    }
+}
+
+template <size_t N>
+const uint8_t* Scanner::findParallel(const std::vector<PeImage::Range>& ranges, const StaticSignature<N>& signature)
+{
+    return findParallel(ranges, N, [&signature](const uint8_t* begin, const uint8_t* end)
+    {
+        return find(begin, end, signature);
+    });
+}
+
+template <size_t N>
+uintptr_t Scanner::scanModule(uintptr_t module, const StaticSignature<N>& signature, SectionKind kind)
+{
+    const PeImage image(module);
+    if (!image.valid()) return 0;
+
+    const auto result = findParallel(image.ranges(kind), signature);
+    return result ? module + (result - image.data()) : 0;
+}
@@ -0,0 +1,107 @@
+﻿#pragma once
+
+#include "signature.h"
+
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define SCANNER_TARGET_AVX2
+#else
+#define SCANNER_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+// Scan loops shared by Signature and StaticSignature<N>. With a StaticSignature the pattern length is a
+// compile-time constant, so the verification loop is fully unrolled.
+namespace scanner_detail
+{
+    inline uint32_t countTrailingZeros(const uint32_t value)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward(&index, value);
+        return index;
+#else
+        return __builtin_ctz(value);
+#endif
+    }
+
+    template <typename Sig>
+    const uint8_t* findScalar(const uint8_t* begin, const uint8_t* end, const Sig& signature)
+    {
+        const auto anchor = signature.anchor();
+        const auto anchorByte = signature.bytes()[anchor];
+        const auto last = end - signature.size();
+
+        for (auto current = begin; current <= last; ++current)
+        {
+            if (current[anchor] != anchorByte) continue;
+            if (signature.matches(current)) return current;
+        }
+        return nullptr;
+    }
+
+    template <typename Sig>
+    const uint8_t* findSSE2(const uint8_t* begin, const uint8_t* end, const Sig& signature)
+    {
+        const auto anchor = signature.anchor();
+        const auto second = signature.secondAnchor() != signature_detail::NPOS ? signature.secondAnchor() : anchor;
+
+        const auto anchorVec = _mm_set1_epi8(static_cast<char>(signature.bytes()[anchor]));
+        const auto secondVec = _mm_set1_epi8(static_cast<char>(signature.bytes()[second]));
+
+        // Every candidate start in [begin, last] can be tested; loads stay inside the buffer because
+        // candidate + anchor < candidate + signature.size() <= end
+        const auto last = end - signature.size();
+        auto current = begin;
+
+        for (; current + 16 <= last + 1; current += 16)
+        {
+            const auto a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(current + anchor));
+            const auto b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(current + second));
+
+            auto candidates = static_cast<uint32_t>(_mm_movemask_epi8(
+                _mm_and_si128(_mm_cmpeq_epi8(a, anchorVec), _mm_cmpeq_epi8(b, secondVec))));
+
+            while (candidates)
+            {
+                const auto offset = countTrailingZeros(candidates);
+                if (signature.matches(current + offset)) return current + offset;
+                candidates &= candidates - 1;
+            }
+        }
+
+        return current <= last ? findScalar(current, end, signature) : nullptr;
+    }
+
+    template <typename Sig>
+    SCANNER_TARGET_AVX2 const uint8_t* findAVX2(const uint8_t* begin, const uint8_t* end, const Sig& signature)
+    {
+        const auto anchor = signature.anchor();
+        const auto second = signature.secondAnchor() != signature_detail::NPOS ? signature.secondAnchor() : anchor;
+
+        const auto anchorVec = _mm256_set1_epi8(static_cast<char>(signature.bytes()[anchor]));
+        const auto secondVec = _mm256_set1_epi8(static_cast<char>(signature.bytes()[second]));
+
+        const auto last = end - signature.size();
+        auto current = begin;
+
+        for (; current + 32 <= last + 1; current += 32)
+        {
+            const auto a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(current + anchor));
+            const auto b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(current + second));
+
+            auto candidates = static_cast<uint32_t>(_mm256_movemask_epi8(
+                _mm256_and_si256(_mm256_cmpeq_epi8(a, anchorVec), _mm256_cmpeq_epi8(b, secondVec))));
+
+            while (candidates)
+            {
+                const auto offset = countTrailingZeros(candidates);
+                if (signature.matches(current + offset)) return current + offset;
+                candidates &= candidates - 1;
+            }
+        }
+
+        return current <= last ? findScalar(current, end, signature) : nullptr;
+    }
+}
@@ -0,0 +1,70 @@
+﻿#include "pch.h"
+#include "signature.h"
+
+using signature_detail::hexValue;
+
+Signature::Signature(std::string_view pattern)
+{
+    size_t i = 0;
+    while (i < pattern.size())
+    {
+        const char c = pattern[i];
+        if (c == ' ')
+        {
+            ++i;
+            continue;
+        }
+
+        if (c == '?')
+        {
+            ++i;
+            if (i < pattern.size() && pattern[i] == '?') ++i;
+            m_bytes.push_back(0);
+            m_mask.push_back(0);
+            continue;
+        }
+
+        const int hi = hexValue(c);
+        const int lo = i + 1 < pattern.size() ? hexValue(pattern[i + 1]) : -1;
+        if (hi < 0 || lo < 0)
+        {
+            m_valid = false;
+            break;
+        }
+
+        m_bytes.push_back(static_cast<uint8_t>(hi << 4 | lo));
+        m_mask.push_back(0xFF);
+        i += 2;
+    }
+
+    signature_detail::selectAnchors(m_bytes.data(), m_mask.data(), m_bytes.size(), m_anchor, m_secondAnchor);
+}
+
+Signature::Signature(const uint8_t* bytes, const uint8_t* mask, size_t length)
+    : m_bytes(bytes, bytes + length)
+    , m_mask(mask, mask + length)
+{
+    // Keep the invariant that masked-out bits are zero so matches() can compare directly
+    for (size_t i = 0; i < length; ++i) m_bytes[i] &= m_mask[i];
+    signature_detail::selectAnchors(m_bytes.data(), m_mask.data(), m_bytes.size(), m_anchor, m_secondAnchor);
+}
+
+std::string Signature::toString() const
+{
+    constexpr char digits[] = "0123456789ABCDEF";
+
+    std::string result;
+    result.reserve(m_bytes.size() * 3);
+    for (size_t i = 0; i < m_bytes.size(); ++i)
+    {
+        if (i) result += ' ';
+        if (m_mask[i] != 0xFF)
+        {
+            result += '?';
+            continue;
+        }
+        result += digits[m_bytes[i] >> 4];
+        result += digits[m_bytes[i] & 0xF];
+    }
+    return result;
+}
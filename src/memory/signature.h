@@ -0,0 +1,226 @@
+﻿#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace signature_detail
+{
+    // Most frequent bytes in x64 code first (padding, REX.W, mov/lea, modrm for stack access, call, jcc...)
+    constexpr uint8_t COMMON_BYTES[] = {
+        0x00, 0xFF, 0x48, 0xCC, 0x8B, 0x89, 0x24, 0x0F, 0x4C, 0x8D, 0x01, 0xE8, 0x44, 0x85, 0x83, 0xC0,
+        0x74, 0x08, 0x10, 0x49, 0x20, 0x40, 0x75, 0x41, 0xC3, 0x84, 0x4D, 0x02, 0x45, 0x33, 0x5C, 0xC7,
+        0x04, 0x18, 0x28, 0x30, 0x38, 0x8E, 0x90, 0xEB, 0xE9, 0xF8, 0xC1, 0x80, 0x4B, 0x03, 0x05, 0x0D
+    };
+
+    // Lower is rarer
+    constexpr int byteFrequency(const uint8_t value)
+    {
+        constexpr int count = static_cast<int>(sizeof(COMMON_BYTES));
+        for (int i = 0; i < count; ++i)
+        {
+            if (COMMON_BYTES[i] == value) return count - i;
+        }
+        return 0;
+    }
+
+    constexpr int hexValue(const char c)
+    {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    constexpr size_t NPOS = static_cast<size_t>(-1);
+
+    // Picks the two rarest fully known bytes
+    constexpr void selectAnchors(const uint8_t* bytes, const uint8_t* mask, size_t length, size_t& anchor,
+                                 size_t& secondAnchor)
+    {
+        anchor = NPOS;
+        secondAnchor = NPOS;
+
+        for (size_t i = 0; i < length; ++i)
+        {
+            if (mask[i] != 0xFF) continue;
+
+            const int freq = byteFrequency(bytes[i]);
+            if (anchor == NPOS || freq < byteFrequency(bytes[anchor]))
+            {
+                secondAnchor = anchor;
+                anchor = i;
+            }
+            else if (secondAnchor == NPOS || freq < byteFrequency(bytes[secondAnchor]))
+            {
+                secondAnchor = i;
+            }
+        }
+    }
+
+    template <size_t N>
+    struct FixedString
+    {
+        char data[N]{};
+
+        consteval FixedString(const char (&str)[N])
+        {
+            for (size_t i = 0; i < N; ++i) data[i] = str[i];
+        }
+
+        static constexpr size_t length() { return N - 1; }
+    };
+
+    // Number of bytes in a pattern; throwing here makes a malformed literal a compile error
+    template <size_t N>
+    consteval size_t countBytes(const FixedString<N>& pattern)
+    {
+        size_t count = 0;
+        size_t known = 0;
+        for (size_t i = 0; i < pattern.length();)
+        {
+            const char c = pattern.data[i];
+            if (c == ' ')
+            {
+                ++i;
+                continue;
+            }
+
+            if (c == '?')
+            {
+                ++i;
+                if (i < pattern.length() && pattern.data[i] == '?') ++i;
+                ++count;
+                continue;
+            }
+
+            if (i + 1 >= pattern.length() || hexValue(c) < 0 || hexValue(pattern.data[i + 1]) < 0)
+                throw "malformed signature: expected two hex digits or a '?' wildcard";
+            if (i + 2 < pattern.length() && pattern.data[i + 2] != ' ')
+                throw "malformed signature: bytes must be separated by spaces";
+
+            ++count;
+            ++known;
+            i += 2;
+        }
+
+        if (known == 0) throw "malformed signature: needs at least one non-wildcard byte";
+        return count;
+    }
+}
+
+// Parsed byte signature, e.g. "48 89 5c 24 ? 57". Wildcards ("?" or "??") have a zero mask byte.
+class Signature
+{
+public:
+    Signature() = default;
+    explicit Signature(std::string_view pattern);
+    Signature(const uint8_t* bytes, const uint8_t* mask, size_t length);
+
+    _NODISCARD size_t size() const { return m_bytes.size(); }
+    _NODISCARD bool empty() const { return m_bytes.empty(); }
+    _NODISCARD bool valid() const { return m_valid && !m_bytes.empty() && m_anchor != npos; }
+
+    _NODISCARD const uint8_t* bytes() const { return m_bytes.data(); }
+    _NODISCARD const uint8_t* mask() const { return m_mask.data(); }
+
+    // Offsets of the two least common non-wildcard bytes, used to pre-filter candidates
+    _NODISCARD size_t anchor() const { return m_anchor; }
+    _NODISCARD size_t secondAnchor() const { return m_secondAnchor; }
+
+    // Canonical "48 8B ? 05" form, independent of how the pattern was written
+    _NODISCARD std::string toString() const;
+
+    _NODISCARD bool matches(const uint8_t* data) const
+    {
+        for (size_t i = 0; i < m_bytes.size(); ++i)
+        {
+            if ((data[i] & m_mask[i]) != m_bytes[i]) return false;
+        }
+        return true;
+    }
+
+    static constexpr size_t npos = signature_detail::NPOS;
+
+private:
+    std::vector<uint8_t> m_bytes;
+    std::vector<uint8_t> m_mask;
+    size_t m_anchor = npos;
+    size_t m_secondAnchor = npos;
+    bool m_valid = true;
+};
+
+// Signature parsed at compile time, see operator""_sig. Same interface as Signature, but the length is
+// part of the type so the scanner can be specialized for it.
+template <size_t N>
+class StaticSignature
+{
+public:
+    template <size_t L>
+    consteval explicit StaticSignature(const signature_detail::FixedString<L>& pattern)
+    {
+        size_t count = 0;
+        for (size_t i = 0; i < pattern.length();)
+        {
+            const char c = pattern.data[i];
+            if (c == ' ')
+            {
+                ++i;
+                continue;
+            }
+
+            if (c == '?')
+            {
+                ++i;
+                if (i < pattern.length() && pattern.data[i] == '?') ++i;
+                m_bytes[count] = 0;
+                m_mask[count] = 0;
+                ++count;
+                continue;
+            }
+
+            m_bytes[count] = static_cast<uint8_t>(signature_detail::hexValue(c) << 4 |
+                signature_detail::hexValue(pattern.data[i + 1]));
+            m_mask[count] = 0xFF;
+            ++count;
+            i += 2;
+        }
+
+        signature_detail::selectAnchors(m_bytes.data(), m_mask.data(), N, m_anchor, m_secondAnchor);
+    }
+
+    static constexpr size_t size() { return N; }
+    static constexpr bool empty() { return N == 0; }
+    static constexpr bool valid() { return N > 0; }
+
+    constexpr const uint8_t* bytes() const { return m_bytes.data(); }
+    constexpr const uint8_t* mask() const { return m_mask.data(); }
+    constexpr size_t anchor() const { return m_anchor; }
+    constexpr size_t secondAnchor() const { return m_secondAnchor; }
+
+    constexpr bool matches(const uint8_t* data) const
+    {
+        for (size_t i = 0; i < N; ++i)
+        {
+            if ((data[i] & m_mask[i]) != m_bytes[i]) return false;
+        }
+        return true;
+    }
+
+    operator Signature() const { return Signature(m_bytes.data(), m_mask.data(), N); }
+
+private:
+    std::array<uint8_t, N> m_bytes{};
+    std::array<uint8_t, N> m_mask{};
+    size_t m_anchor = signature_detail::NPOS;
+    size_t m_secondAnchor = signature_detail::NPOS;
+};
+
+// "48 89 5c 24 ? 57"_sig, validated and converted to byte/mask arrays at compile time
+template <signature_detail::FixedString Pattern>
+consteval auto operator""_sig()
+{
+    return StaticSignature<signature_detail::countBytes(Pattern)>(Pattern);
+}
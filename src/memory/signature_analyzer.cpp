@@ -0,0 +1,220 @@
+﻿#include "pch.h"
+#include "signature_analyzer.h"
+
+#include "scanner.h"
+#include "x64_decoder.h"
+
+SignatureAnalyzer::SignatureAnalyzer(uintptr_t module, SectionKind kind)
+    : m_module(module)
+{
+    const PeImage image(module);
+    if (!image.valid()) return;
+
+    for (const auto& range : image.ranges(kind))
+    {
+        m_ranges.push_back({
+            static_cast<uint32_t>(range.begin - image.data()),
+            static_cast<uint32_t>(range.end - image.data())
+        });
+    }
+
+    buildIndex();
+    m_valid = true;
+}
+
+void SignatureAnalyzer::buildIndex()
+{
+    // Counting sort of every window position by bucket, positions end up ascending inside a bucket
+    constexpr size_t bucketCount = size_t{1} << BUCKET_BITS;
+    m_bucketStart.assign(bucketCount + 1, 0);
+
+    const auto data = reinterpret_cast<const uint8_t*>(m_module);
+    size_t total = 0;
+
+    for (const auto& range : m_ranges)
+    {
+        if (range.end - range.begin < WINDOW) continue;
+        for (uint32_t rva = range.begin; rva + WINDOW <= range.end; ++rva) ++m_bucketStart[bucketOf(data + rva) + 1];
+        total += range.end - range.begin - WINDOW + 1;
+    }
+
+    for (size_t i = 1; i <= bucketCount; ++i) m_bucketStart[i] += m_bucketStart[i - 1];
+
+    m_positions.resize(total);
+    std::vector<uint32_t> cursor(m_bucketStart.begin(), m_bucketStart.end() - 1);
+
+    for (const auto& range : m_ranges)
+    {
+        if (range.end - range.begin < WINDOW) continue;
+        for (uint32_t rva = range.begin; rva + WINDOW <= range.end; ++rva)
+            m_positions[cursor[bucketOf(data + rva)]++] = rva;
+    }
+}
+
+uint32_t SignatureAnalyzer::bucketOf(const uint8_t* data)
+{
+    uint32_t word;
+    memcpy(&word, data, sizeof(word));
+    return (word * 0x9E3779B1u) >> (32 - BUCKET_BITS);
+}
+
+const SignatureAnalyzer::Range* SignatureAnalyzer::rangeOf(uint32_t rva, size_t length) const
+{
+    // Ranges are sorted and disjoint, the candidate is the last one starting at or before rva
+    const auto it = std::upper_bound(m_ranges.begin(), m_ranges.end(), rva, [](uint32_t value, const Range& range)
+    {
+        return value < range.begin;
+    });
+    if (it == m_ranges.begin()) return nullptr;
+
+    const auto& range = *std::prev(it);
+    if (rva >= range.end || range.end - rva < length) return nullptr;
+    return &range;
+}
+
+size_t SignatureAnalyzer::bestWindow(const Signature& signature) const
+{
+    if (signature.size() < WINDOW) return Signature::npos;
+
+    size_t best = Signature::npos;
+    uint32_t bestCount = UINT32_MAX;
+
+    for (size_t i = 0; i + WINDOW <= signature.size(); ++i)
+    {
+        const auto mask = signature.mask() + i;
+        if ((mask[0] & mask[1] & mask[2] & mask[3]) != 0xFF) continue;
+
+        const auto bucket = bucketOf(signature.bytes() + i);
+        const auto count = m_bucketStart[bucket + 1] - m_bucketStart[bucket];
+        if (count < bestCount)
+        {
+            best = i;
+            bestCount = count;
+            if (count == 0) break;
+        }
+    }
+    return best;
+}
+
+template <typename Fn>
+void SignatureAnalyzer::forEachMatch(const Signature& signature, size_t limit, Fn&& fn) const
+{
+    if (!m_valid || !signature.valid() || limit == 0) return;
+
+    const auto data = reinterpret_cast<const uint8_t*>(m_module);
+    size_t found = 0;
+
+    const auto window = bestWindow(signature);
+    if (window == Signature::npos)
+    {
+        // No fully known window to look up, fall back to a linear scan
+        std::vector<PeImage::Range> ranges;
+        for (const auto& range : m_ranges) ranges.push_back({data + range.begin, data + range.end});
+
+        for (const auto address : Scanner::findAll(std::move(ranges), signature))
+        {
+            fn(address);
+            if (++found >= limit) return;
+        }
+        return;
+    }
+
+    const auto bucket = bucketOf(signature.bytes() + window);
+    for (auto i = m_bucketStart[bucket]; i < m_bucketStart[bucket + 1]; ++i)
+    {
+        const auto position = m_positions[i];
+        if (position < window) continue;
+
+        // The window can match in a different place of the signature's range, or collide in the hash
+        const auto start = static_cast<uint32_t>(position - window);
+        if (!rangeOf(start, signature.size()) || !signature.matches(data + start)) continue;
+
+        fn(m_module + start);
+        if (++found >= limit) return;
+    }
+}
+
+size_t SignatureAnalyzer::count(const Signature& signature, size_t limit) const
+{
+    size_t result = 0;
+    forEachMatch(signature, limit, [&result](uintptr_t) { ++result; });
+    return result;
+}
+
+std::vector<uintptr_t> SignatureAnalyzer::findAll(const Signature& signature, size_t limit) const
+{
+    std::vector<uintptr_t> result;
+    forEachMatch(signature, limit, [&result](uintptr_t address) { result.push_back(address); });
+    return result;
+}
+
+std::optional<Signature> SignatureAnalyzer::generate(uintptr_t address, const Options& options) const
+{
+    if (!m_valid || address < m_module) return std::nullopt;
+
+    const auto rva = static_cast<uint32_t>(address - m_module);
+    const auto range = rangeOf(rva, 1);
+    if (!range)
+    {
+        LOG_WARN("SignatureAnalyzer: {:#x} is outside of the indexed sections", address);
+        return std::nullopt;
+    }
+
+    const auto code = reinterpret_cast<const uint8_t*>(address);
+    const size_t available = (std::min)(static_cast<size_t>(range->end - rva), options.maxLength);
+
+    std::vector<uint8_t> bytes;
+    std::vector<uint8_t> mask;
+
+    // Whole instructions only, so every relocatable field is known before it is copied
+    while (bytes.size() < available)
+    {
+        const auto offset = bytes.size();
+
+        X64Decoder::Instruction instruction;
+        if (!X64Decoder::decode(code + offset, available - offset, instruction)) break;
+
+        bytes.insert(bytes.end(), code + offset, code + offset + instruction.length);
+        mask.insert(mask.end(), instruction.length, 0xFF);
+
+        const auto wildcard = [&](uint8_t fieldOffset, uint8_t fieldSize)
+        {
+            std::fill_n(mask.begin() + static_cast<ptrdiff_t>(offset + fieldOffset), fieldSize, 0);
+        };
+
+        if (instruction.ripRelative && options.maskRipRelative)
+            wildcard(instruction.dispOffset, instruction.dispSize);
+
+        if (instruction.immSize && (instruction.relative ? options.maskBranches : options.maskImmediates))
+            wildcard(instruction.immOffset, instruction.immSize);
+    }
+
+    if (bytes.empty())
+    {
+        LOG_WARN("SignatureAnalyzer: no instruction could be decoded at {:#x}", address);
+        return std::nullopt;
+    }
+
+    const auto isUniqueAt = [&](size_t length)
+    {
+        return isUnique(Signature(bytes.data(), mask.data(), length));
+    };
+
+    if (!isUniqueAt(bytes.size()))
+    {
+        LOG_WARN("SignatureAnalyzer: no unique signature within {} bytes at {:#x}", bytes.size(), address);
+        return std::nullopt;
+    }
+
+    // A longer prefix only adds constraints, so uniqueness is monotonic in the length
+    size_t low = 1;
+    size_t high = bytes.size();
+    while (low < high)
+    {
+        const auto middle = low + (high - low) / 2;
+        if (isUniqueAt(middle)) high = middle;
+        else low = middle + 1;
+    }
+
+    return Signature(bytes.data(), mask.data(), low);
+}
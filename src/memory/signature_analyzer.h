@@ -0,0 +1,72 @@
+﻿#pragma once
+
+#include "pe_image.h"
+#include "signature.h"
+
+#include <optional>
+
+// Tooling for writing signatures: counts every match of a signature in an image and generates the
+// shortest unique signature for an address. Works on any laid out image, including PeFile::base(), so
+// signatures can be checked against a game binary offline.
+//
+// Construction builds an index of every 4 byte window in the scanned sections (4 bytes of memory per
+// byte of code), after which each lookup only verifies the positions sharing the rarest window.
+class SignatureAnalyzer
+{
+public:
+    struct Options
+    {
+        bool maskRipRelative = true; // [rip + disp32] operands move whenever the data layout changes
+        bool maskBranches = true;    // call/jmp/jcc displacements
+        bool maskImmediates = true;  // constants, struct offsets, stack frame sizes
+        size_t maxLength = 96;       // give up if the signature is still ambiguous after this many bytes
+    };
+
+    explicit SignatureAnalyzer(uintptr_t module, SectionKind kind = SectionKind::Code);
+
+    _NODISCARD bool valid() const { return m_valid; }
+
+    // Number of matches, stops counting at 'limit'
+    _NODISCARD size_t count(const Signature& signature, size_t limit = SIZE_MAX) const;
+
+    // Absolute addresses of all matches, in ascending order
+    _NODISCARD std::vector<uintptr_t> findAll(const Signature& signature, size_t limit = SIZE_MAX) const;
+
+    _NODISCARD bool isUnique(const Signature& signature) const { return count(signature, 2) == 1; }
+
+    // Shortest signature starting at 'address' that matches only there. Instructions are decoded so
+    // relocatable fields can be wildcarded, the result is cut at the first byte that makes it unique.
+    _NODISCARD std::optional<Signature> generate(uintptr_t address, const Options& options) const;
+    _NODISCARD std::optional<Signature> generate(uintptr_t address) const { return generate(address, Options{}); }
+
+    static constexpr size_t WINDOW = 4;
+    static constexpr uint32_t BUCKET_BITS = 22;
+
+private:
+    struct Range
+    {
+        uint32_t begin; // RVA
+        uint32_t end;
+    };
+
+    void buildIndex();
+
+    // Range containing [rva, rva + length) or nullptr
+    _NODISCARD const Range* rangeOf(uint32_t rva, size_t length) const;
+
+    // Offset of the fully known window with the fewest indexed positions, npos if there is none
+    _NODISCARD size_t bestWindow(const Signature& signature) const;
+
+    template <typename Fn>
+    void forEachMatch(const Signature& signature, size_t limit, Fn&& fn) const;
+
+    static uint32_t bucketOf(const uint8_t* data);
+
+    uintptr_t m_module;
+    bool m_valid = false;
+    std::vector<Range> m_ranges;
+
+    // Positions grouped by bucket: bucket b holds m_positions[m_bucketStart[b] .. m_bucketStart[b + 1])
+    std::vector<uint32_t> m_bucketStart;
+    std::vector<uint32_t> m_positions;
+};
@@ -0,0 +1,234 @@
+﻿#include "pch.h"
+#include "signature_cache.h"
+
+#include "core/config/config_manager.h"
+
+SignatureCache& SignatureCache::getInstance()
+{
+    static SignatureCache instance;
+    return instance;
+}
+
+uintptr_t SignatureCache::resolve(uintptr_t module, const Signature& signature, SectionKind kind)
+{
+    return resolve(module, signature, kind, [module, &signature, kind]
+    {
+        return Mem::patternScan(module, signature, kind);
+    });
+}
+
+uintptr_t SignatureCache::resolve(uintptr_t module, const Signature& signature, SectionKind kind,
+                                  const ScanFn& scan)
+{
+    if (!module || !signature.valid()) return 0;
+
+    std::lock_guard lock(m_mutex);
+    load();
+
+    const auto& identity = identify(module);
+    auto& entries = moduleEntries(identity);
+
+    const auto key = std::string(magic_enum::enum_name(kind)) + ":" + signature.toString();
+
+    if (const auto it = entries.find(key); it != entries.end())
+    {
+        const auto found = it->value("found", false);
+        const auto rva = it->value("rva", 0ull);
+
+        // Known to be missing from this exact binary
+        if (!found)
+        {
+            ++m_stats.hits;
+            return 0;
+        }
+
+        // Cheap sanity check, the bytes at the cached RVA must still match
+        if (rva + signature.size() <= identity.sizeOfImage &&
+            signature.matches(reinterpret_cast<const uint8_t*>(module + rva)))
+        {
+            ++m_stats.hits;
+            return module + rva;
+        }
+
+        LOG_WARN("Cached signature in {} no longer matches at {:#x}, rescanning", identity.name, rva);
+        ++m_stats.staleEntries;
+    }
+
+    ++m_stats.misses;
+    const auto address = scan();
+
+    // Misses are rare (first launch or after an update), persist straight away
+    entries[key] = {{"found", address != 0}, {"rva", address ? address - module : 0}};
+    saveLocked();
+
+    return address;
+}
+
+void SignatureCache::setHashCodeSections(bool enabled)
+{
+    std::lock_guard lock(m_mutex);
+    if (m_hashCodeSections == enabled) return;
+
+    m_hashCodeSections = enabled;
+    m_identities.clear();
+}
+
+void SignatureCache::clear()
+{
+    std::lock_guard lock(m_mutex);
+    m_data = {{"version", CACHE_VERSION}, {"modules", nlohmann::json::object()}};
+    m_loaded = true;
+    saveLocked();
+}
+
+bool SignatureCache::save()
+{
+    std::lock_guard lock(m_mutex);
+    return saveLocked();
+}
+
+SignatureCache::Stats SignatureCache::getStats() const
+{
+    std::lock_guard lock(m_mutex);
+    return m_stats;
+}
+
+void SignatureCache::load()
+{
+    if (m_loaded) return;
+    m_loaded = true;
+
+    m_data = {{"version", CACHE_VERSION}, {"modules", nlohmann::json::object()}};
+
+    std::ifstream file(getCachePath());
+    if (!file.good()) return;
+
+    try
+    {
+        nlohmann::json loaded;
+        file >> loaded;
+
+        if (loaded.value("version", 0) != CACHE_VERSION || !loaded.contains("modules") ||
+            !loaded["modules"].is_object())
+        {
+            LOG_INFO("Signature cache has an old format, starting fresh");
+            return;
+        }
+
+        m_data = std::move(loaded);
+    }
+    catch (const std::exception& e)
+    {
+        LOG_WARN("Failed to parse signature cache, starting fresh: {}", e.what());
+    }
+}
+
+bool SignatureCache::saveLocked() const
+{
+    const auto path = getCachePath();
+
+    try
+    {
+        // Write to a temp file and swap so a crash never leaves a truncated cache behind
+        const auto tempPath = path.string() + ".tmp";
+        std::ofstream file(tempPath, std::ios::trunc);
+        if (!file.good())
+        {
+            LOG_ERROR("Failed to open signature cache for writing: {}", tempPath);
+            return false;
+        }
+
+        file << m_data.dump(2);
+        file.close();
+
+        std::error_code ec;
+        std::filesystem::rename(tempPath, path, ec);
+        if (ec)
+        {
+            LOG_ERROR("Failed to write signature cache: {}", ec.message());
+            return false;
+        }
+        return true;
+    }
+    catch (const std::exception& e)
+    {
+        LOG_ERROR("Failed to save signature cache: {}", e.what());
+        return false;
+    }
+}
+
+std::filesystem::path SignatureCache::getCachePath() const
+{
+    return ConfigManager::getInstance().getConfigDirectoryPath() / "signature_cache.json";
+}
+
+const SignatureCache::ModuleIdentity& SignatureCache::identify(uintptr_t module)
+{
+    if (const auto it = m_identities.find(module); it != m_identities.end()) return it->second;
+
+    const PeImage image(module);
+
+    ModuleIdentity identity;
+    identity.name = moduleName(module);
+    identity.timeDateStamp = image.timeDateStamp();
+    identity.sizeOfImage = image.sizeOfImage();
+    if (m_hashCodeSections) identity.codeHash = hashRanges(image.ranges(SectionKind::Code));
+
+    return m_identities.emplace(module, std::move(identity)).first->second;
+}
+
+nlohmann::json& SignatureCache::moduleEntries(const ModuleIdentity& identity)
+{
+    auto& node = m_data["modules"][identity.name];
+
+    const bool matches = node.is_object() &&
+        node.value("timeDateStamp", 0u) == identity.timeDateStamp &&
+        node.value("sizeOfImage", 0u) == identity.sizeOfImage &&
+        (!m_hashCodeSections || node.value("codeHash", 0ull) == identity.codeHash);
+
+    if (!matches)
+    {
+        if (node.is_object())
+        {
+            LOG_INFO("{} changed since the signature cache was written, invalidating", identity.name);
+            ++m_stats.invalidations;
+        }
+
+        node = {
+            {"timeDateStamp", identity.timeDateStamp},
+            {"sizeOfImage", identity.sizeOfImage},
+            {"codeHash", identity.codeHash},
+            {"signatures", nlohmann::json::object()}
+        };
+    }
+
+    return node["signatures"];
+}
+
+std::string SignatureCache::moduleName(uintptr_t module)
+{
+    char path[MAX_PATH];
+    if (!GetModuleFileNameA(reinterpret_cast<HMODULE>(module), path, MAX_PATH)) return std::format("{:#x}", module);
+    return std::filesystem::path(path).filename().string();
+}
+
+uint64_t SignatureCache::hashRanges(const std::vector<PeImage::Range>& ranges)
+{
+    // 64-bit multiply-xorshift over 8 byte words, only used to detect changes
+    constexpr uint64_t prime = 0x9E3779B97F4A7C15ull;
+    uint64_t hash = 0xCBF29CE484222325ull;
+
+    for (const auto& range : ranges)
+    {
+        auto current = range.begin;
+        for (; current + 8 <= range.end; current += 8)
+        {
+            uint64_t word;
+            memcpy(&word, current, sizeof(word));
+            hash = (hash ^ word) * prime;
+            hash ^= hash >> 29;
+        }
+        for (; current < range.end; ++current) hash = (hash ^ *current) * prime;
+    }
+    return hash;
+}
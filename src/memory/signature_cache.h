@@ -0,0 +1,83 @@
+﻿#pragma once
+
+#include "mem.h"
+
+// On-disk cache of resolved signature RVAs, stored next to the config. Entries are grouped per module and
+// keyed by the module identity (file name, PE TimeDateStamp, SizeOfImage and optionally a hash of the
+// code sections), so a game update invalidates them automatically.
+class SignatureCache
+{
+public:
+    struct Stats
+    {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t invalidations = 0; // modules whose cached entries were dropped because the binary changed
+        uint64_t staleEntries = 0;  // entries that no longer matched the bytes at the cached RVA
+    };
+
+    static SignatureCache& getInstance();
+
+    // Returns the cached address when the module is unchanged, otherwise scans and records the result
+    uintptr_t resolve(uintptr_t module, const Signature& signature, SectionKind kind = SectionKind::Code);
+
+    template <size_t N>
+    uintptr_t resolve(uintptr_t module, const StaticSignature<N>& signature, SectionKind kind = SectionKind::Code);
+
+    // Hashing the code sections catches patched binaries that kept their timestamp, at the cost of reading
+    // the whole code once per module and session
+    void setHashCodeSections(bool enabled);
+
+    void clear();
+    bool save();
+
+    _NODISCARD Stats getStats() const;
+
+    SignatureCache(const SignatureCache&) = delete;
+    SignatureCache& operator=(const SignatureCache&) = delete;
+
+private:
+    SignatureCache() = default;
+
+    struct ModuleIdentity
+    {
+        std::string name;
+        uint32_t timeDateStamp = 0;
+        uint32_t sizeOfImage = 0;
+        uint64_t codeHash = 0;
+    };
+
+    using ScanFn = std::function<uintptr_t()>;
+
+    mutable std::mutex m_mutex;
+    nlohmann::json m_data;
+    bool m_loaded = false;
+    bool m_hashCodeSections = false;
+    Stats m_stats;
+
+    // Identity of every module seen this session, keyed by base address
+    std::unordered_map<uintptr_t, ModuleIdentity> m_identities;
+
+    uintptr_t resolve(uintptr_t module, const Signature& signature, SectionKind kind, const ScanFn& scan);
+
+    void load();
+    bool saveLocked() const;
+    std::filesystem::path getCachePath() const;
+
+    const ModuleIdentity& identify(uintptr_t module);
+    nlohmann::json& moduleEntries(const ModuleIdentity& identity);
+
+    static std::string moduleName(uintptr_t module);
+    static uint64_t hashRanges(const std::vector<PeImage::Range>& ranges);
+
+    static constexpr int CACHE_VERSION = 1;
+};
+
+template <size_t N>
+uintptr_t SignatureCache::resolve(uintptr_t module, const StaticSignature<N>& signature, SectionKind kind)
+{
+    return resolve(module, Signature(signature), kind, [module, &signature, kind]
+    {
+        return Mem::patternScan(module, signature, kind);
+    });
+}
@@ -0,0 +1,77 @@
+﻿#include "pch.h"
+#include "string_index.h"
+
+namespace
+{
+    bool isText(uint32_t c)
+    {
+        return (c >= 0x20 && c < 0x7F) || c == '\t' || c == '\n' || c == '\r';
+    }
+}
+
+StringIndex::StringIndex(uintptr_t module, size_t minLength)
+{
+    const PeImage image(module);
+    if (!image.valid()) return;
+
+    for (const auto& range : image.ranges(SectionKind::Data)) indexRange(range.begin, range.end, minLength);
+    m_valid = true;
+}
+
+void StringIndex::indexRange(const uint8_t* begin, const uint8_t* end, size_t minLength)
+{
+    // ASCII: a run of text bytes followed by a NUL
+    for (auto current = begin; current < end;)
+    {
+        auto stringEnd = current;
+        while (stringEnd < end && isText(*stringEnd)) ++stringEnd;
+
+        const auto length = static_cast<size_t>(stringEnd - current);
+        if (stringEnd < end && *stringEnd == 0 && length >= minLength)
+        {
+            const std::string_view text(reinterpret_cast<const char*>(current), length);
+            m_ascii[text].push_back(reinterpret_cast<uintptr_t>(current));
+        }
+        current = stringEnd + 1;
+    }
+
+    // UTF-16: 2 byte aligned, only the ASCII subset is recognized (text character then a zero high byte)
+    const auto alignedBegin = begin + (reinterpret_cast<uintptr_t>(begin) & 1);
+    for (auto current = alignedBegin; current + 2 <= end;)
+    {
+        auto stringEnd = current;
+        while (stringEnd + 2 <= end && stringEnd[1] == 0 && isText(stringEnd[0])) stringEnd += 2;
+
+        const auto length = static_cast<size_t>(stringEnd - current) / 2;
+        if (stringEnd + 2 <= end && stringEnd[0] == 0 && stringEnd[1] == 0 && length >= minLength)
+        {
+            const std::u16string_view text(reinterpret_cast<const char16_t*>(current), length);
+            m_wide[text].push_back(reinterpret_cast<uintptr_t>(current));
+        }
+        current = stringEnd + 2;
+    }
+}
+
+std::vector<uintptr_t> StringIndex::find(std::string_view text) const
+{
+    const auto it = m_ascii.find(text);
+    return it != m_ascii.end() ? it->second : std::vector<uintptr_t>{};
+}
+
+std::vector<uintptr_t> StringIndex::find(std::u16string_view text) const
+{
+    const auto it = m_wide.find(text);
+    return it != m_wide.end() ? it->second : std::vector<uintptr_t>{};
+}
+
+std::vector<uintptr_t> StringIndex::search(std::string_view text) const
+{
+    std::vector<uintptr_t> result;
+    for (const auto& [string, addresses] : m_ascii)
+    {
+        if (string.find(text) != std::string_view::npos)
+            result.insert(result.end(), addresses.begin(), addresses.end());
+    }
+    std::ranges::sort(result);
+    return result;
+}
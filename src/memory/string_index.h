@@ -0,0 +1,35 @@
+﻿#pragma once
+
+#include "pe_image.h"
+
+#include <string_view>
+#include <unordered_map>
+
+// NUL-terminated ASCII and UTF-16 strings found in the data sections of an image, mapped to the
+// addresses they are stored at. Pair it with XrefIndex to go from a string to the code using it.
+// Views point into the image, which must stay mapped while the index is used.
+class StringIndex
+{
+public:
+    explicit StringIndex(uintptr_t module, size_t minLength = MIN_LENGTH);
+
+    _NODISCARD bool valid() const { return m_valid; }
+
+    // Addresses of every copy of exactly this string
+    _NODISCARD std::vector<uintptr_t> find(std::string_view text) const;
+    _NODISCARD std::vector<uintptr_t> find(std::u16string_view text) const;
+
+    // Addresses of ASCII strings containing 'text', linear in the number of strings
+    _NODISCARD std::vector<uintptr_t> search(std::string_view text) const;
+
+    _NODISCARD size_t size() const { return m_ascii.size() + m_wide.size(); }
+
+    static constexpr size_t MIN_LENGTH = 4;
+
+private:
+    void indexRange(const uint8_t* begin, const uint8_t* end, size_t minLength);
+
+    bool m_valid = false;
+    std::unordered_map<std::string_view, std::vector<uintptr_t>> m_ascii;
+    std::unordered_map<std::u16string_view, std::vector<uintptr_t>> m_wide;
+};
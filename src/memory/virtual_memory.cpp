@@ -0,0 +1,244 @@
+﻿#include "pch.h"
+#include "virtual_memory.h"
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    struct FreeRegion
+    {
+        uintptr_t begin;
+        uintptr_t end;
+    };
+
+    // Unallocated regions intersecting [low, high)
+    std::vector<FreeRegion> freeRegions(uintptr_t low, uintptr_t high)
+    {
+        std::vector<FreeRegion> regions;
+#ifdef _WIN32
+        // One VirtualQuery per region, RegionSize skips over everything with the same state
+        MEMORY_BASIC_INFORMATION mbi;
+        for (auto current = low; current < high;)
+        {
+            if (!VirtualQuery(reinterpret_cast<LPCVOID>(current), &mbi, sizeof(mbi))) break;
+
+            const auto begin = reinterpret_cast<uintptr_t>(mbi.BaseAddress);
+            const auto end = begin + mbi.RegionSize;
+            if (mbi.State == MEM_FREE) regions.push_back({begin, end});
+            if (end <= current) break;
+            current = end;
+        }
+#else
+        // Mappings are listed in ascending order, the gaps between them are free
+        std::ifstream maps("/proc/self/maps");
+        std::string line;
+        uintptr_t previousEnd = VirtualMemory::allocationGranularity();
+        while (std::getline(maps, line))
+        {
+            char* cursor = nullptr;
+            const auto begin = static_cast<uintptr_t>(strtoull(line.c_str(), &cursor, 16));
+            if (*cursor != '-') continue;
+            const auto end = static_cast<uintptr_t>(strtoull(cursor + 1, nullptr, 16));
+
+            if (begin > previousEnd && begin > low && previousEnd < high) regions.push_back({previousEnd, begin});
+            previousEnd = (std::max)(previousEnd, end);
+            if (previousEnd >= high) break;
+        }
+
+        // Up to the end of the user address space (47 bits)
+        constexpr uintptr_t userLimit = uintptr_t{1} << 47;
+        if (previousEnd < high && previousEnd < userLimit) regions.push_back({previousEnd, userLimit});
+#endif
+        return regions;
+    }
+
+    void* allocateAt(uintptr_t address, size_t size)
+    {
+#ifdef _WIN32
+        return VirtualAlloc(reinterpret_cast<LPVOID>(address), size, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+#else
+#ifdef MAP_FIXED_NOREPLACE
+        constexpr int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE;
+#else
+        constexpr int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#endif
+        const auto result = mmap(reinterpret_cast<void*>(address), size, PROT_READ | PROT_WRITE | PROT_EXEC, flags,
+                                 -1, 0);
+        if (result == MAP_FAILED) return nullptr;
+
+        // Without MAP_FIXED_NOREPLACE the address is only a hint
+        if (reinterpret_cast<uintptr_t>(result) != address)
+        {
+            munmap(result, size);
+            return nullptr;
+        }
+        return result;
+#endif
+    }
+}
+
+size_t VirtualMemory::pageSize()
+{
+#ifdef _WIN32
+    static const size_t size = []
+    {
+        SYSTEM_INFO si;
+        GetSystemInfo(&si);
+        return static_cast<size_t>(si.dwPageSize);
+    }();
+#else
+    static const size_t size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+    return size;
+}
+
+size_t VirtualMemory::allocationGranularity()
+{
+#ifdef _WIN32
+    static const size_t granularity = []
+    {
+        SYSTEM_INFO si;
+        GetSystemInfo(&si);
+        return static_cast<size_t>(si.dwAllocationGranularity);
+    }();
+    return granularity;
+#else
+    return pageSize();
+#endif
+}
+
+bool VirtualMemory::query(uintptr_t address, Region& region)
+{
+#ifdef _WIN32
+    MEMORY_BASIC_INFORMATION mbi;
+    if (!VirtualQuery(reinterpret_cast<LPCVOID>(address), &mbi, sizeof(mbi)) || mbi.State != MEM_COMMIT) return false;
+
+    region.begin = reinterpret_cast<uintptr_t>(mbi.BaseAddress);
+    region.end = region.begin + mbi.RegionSize;
+    region.protection = mbi.Protect;
+    return true;
+#else
+    // Each line: "begin-end perms offset dev inode path"
+    std::ifstream maps("/proc/self/maps");
+    std::string line;
+    while (std::getline(maps, line))
+    {
+        char* cursor = nullptr;
+        const auto begin = static_cast<uintptr_t>(strtoull(line.c_str(), &cursor, 16));
+        if (*cursor != '-') continue;
+        const auto end = static_cast<uintptr_t>(strtoull(cursor + 1, &cursor, 16));
+
+        if (address < begin || address >= end) continue;
+        if (strlen(cursor) < 4) return false;
+
+        const auto perms = cursor + 1;
+        region.begin = begin;
+        region.end = end;
+        region.protection = (perms[0] == 'r' ? PROT_READ : 0) | (perms[1] == 'w' ? PROT_WRITE : 0) |
+            (perms[2] == 'x' ? PROT_EXEC : 0);
+        return true;
+    }
+    return false;
+#endif
+}
+
+bool VirtualMemory::protect(uintptr_t address, size_t size, uint32_t protection)
+{
+#ifdef _WIN32
+    DWORD oldProtect;
+    return VirtualProtect(reinterpret_cast<LPVOID>(address), size, protection, &oldProtect) != 0;
+#else
+    const auto begin = pageFloor(address);
+    return mprotect(reinterpret_cast<void*>(begin), pageCeil(address + size) - begin, static_cast<int>(protection)) == 0;
+#endif
+}
+
+bool VirtualMemory::isReadable(uintptr_t address, size_t size)
+{
+    Region region;
+    if (!query(address, region) || address + size > region.end) return false;
+
+#ifdef _WIN32
+    return !(region.protection & (PAGE_NOACCESS | PAGE_GUARD));
+#else
+    return (region.protection & PROT_READ) != 0;
+#endif
+}
+
+bool VirtualMemory::makeWritable(uintptr_t address, size_t size)
+{
+#ifdef _WIN32
+    return protect(address, size, PAGE_EXECUTE_READWRITE);
+#else
+    return protect(address, size, PROT_READ | PROT_WRITE | PROT_EXEC);
+#endif
+}
+
+void VirtualMemory::flushInstructionCache(uintptr_t address, size_t size)
+{
+#ifdef _WIN32
+    FlushInstructionCache(GetCurrentProcess(), reinterpret_cast<LPCVOID>(address), size);
+#else
+    __builtin___clear_cache(reinterpret_cast<char*>(address), reinterpret_cast<char*>(address + size));
+#endif
+}
+
+void* VirtualMemory::allocateNear(uintptr_t address, size_t size, size_t maxDistance)
+{
+    const auto granularity = allocationGranularity();
+    size = (size + granularity - 1) & ~(granularity - 1);
+
+    const auto low = address > maxDistance + granularity ? address - maxDistance : granularity;
+    const auto high = UINTPTR_MAX - address > maxDistance ? address + maxDistance : UINTPTR_MAX;
+
+    // The closest aligned block inside each free region, nearest first
+    std::vector<uintptr_t> candidates;
+    for (const auto& region : freeRegions(low, high))
+    {
+        const auto begin = (std::max)(region.begin, low);
+        const auto end = (std::min)(region.end, high);
+        if (end <= begin || end - begin < size) continue;
+
+        uintptr_t candidate;
+        if (end <= address) candidate = (end - size) & ~(granularity - 1);
+        else candidate = ((std::max)(begin, address) + granularity - 1) & ~(granularity - 1);
+
+        if (candidate >= begin && candidate + size <= end) candidates.push_back(candidate);
+    }
+
+    const auto distance = [address](uintptr_t candidate)
+    {
+        return candidate > address ? candidate - address : address - candidate;
+    };
+    std::ranges::sort(candidates, {}, distance);
+
+    // Another thread may grab a region between the walk and the allocation, move on to the next one
+    for (const auto candidate : candidates)
+    {
+        if (const auto result = allocateAt(candidate, size)) return result;
+    }
+    return nullptr;
+}
+
+void* VirtualMemory::allocate(size_t size)
+{
+#ifdef _WIN32
+    return VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+#else
+    const auto result = mmap(nullptr, size, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return result == MAP_FAILED ? nullptr : result;
+#endif
+}
+
+void VirtualMemory::release(void* address, size_t size)
+{
+#ifdef _WIN32
+    (void)size;
+    VirtualFree(address, 0, MEM_RELEASE);
+#else
+    munmap(address, size);
+#endif
+}
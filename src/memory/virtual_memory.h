@@ -0,0 +1,49 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Thin wrapper over the OS virtual memory API (VirtualQuery/VirtualProtect on Windows, /proc/self/maps and
+// mprotect elsewhere) so the patching code can be exercised on Linux as well.
+class VirtualMemory
+{
+public:
+    // Protection values are the native ones: PAGE_* on Windows, PROT_* bits elsewhere
+    struct Region
+    {
+        uintptr_t begin;
+        uintptr_t end;
+        uint32_t protection;
+    };
+
+    static size_t pageSize();
+
+    // Alignment of reservations: 64 KB on Windows, the page size elsewhere
+    static size_t allocationGranularity();
+
+    _NODISCARD static uintptr_t pageFloor(uintptr_t address) { return address & ~(pageSize() - 1); }
+    _NODISCARD static uintptr_t pageCeil(uintptr_t address) { return pageFloor(address + pageSize() - 1); }
+
+    // Region of pages sharing the same protection that contains 'address'
+    static bool query(uintptr_t address, Region& region);
+
+    static bool protect(uintptr_t address, size_t size, uint32_t protection);
+
+    // Committed and readable, for dereferencing pointers taken from code that might not be code
+    static bool isReadable(uintptr_t address, size_t size);
+
+    // Read, write and execute, so code keeps running while it is being patched
+    static bool makeWritable(uintptr_t address, size_t size);
+
+    static void flushInstructionCache(uintptr_t address, size_t size);
+
+    // Commits 'size' bytes of read/write/execute memory as close to 'address' as possible, never further
+    // than 'maxDistance' away from it. Free regions are found by walking the address space region by
+    // region, not page by page. Returns nullptr if nothing in range is free.
+    static void* allocateNear(uintptr_t address, size_t size, size_t maxDistance);
+
+    // Read/write/execute memory anywhere
+    static void* allocate(size_t size);
+
+    static void release(void* address, size_t size);
+};
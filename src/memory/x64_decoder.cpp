@@ -0,0 +1,305 @@
+﻿#include "pch.h"
+#include "x64_decoder.h"
+
+#include <array>
+
+namespace
+{
+    enum OpFlags : uint16_t
+    {
+        None = 0,
+        ModRM = 1 << 0,
+        Imm8 = 1 << 1,
+        Imm16 = 1 << 2,
+        ImmZ = 1 << 3,    // 16 with 66, else 32
+        ImmV = 1 << 4,    // 16 with 66, 64 with REX.W, else 32 (mov r, imm)
+        Rel8 = 1 << 5,
+        RelZ = 1 << 6,    // rel32
+        Moffs = 1 << 7,   // 64-bit absolute address (32 with 67)
+        Group3 = 1 << 8,  // F6/F7: test has an immediate, the rest of the group does not
+        Invalid = 1 << 9,
+        Prefix = 1 << 10,
+        Escape = 1 << 11, // 0F
+        Vex = 1 << 12,    // C4/C5/62 are VEX/EVEX in 64-bit mode
+    };
+
+    struct Span
+    {
+        uint8_t first;
+        uint8_t last;
+        uint16_t flags;
+    };
+
+    template <size_t N>
+    consteval std::array<uint16_t, 256> buildTable(uint16_t fallback, const Span (&spans)[N])
+    {
+        std::array<uint16_t, 256> table{};
+        for (auto& entry : table) entry = fallback;
+        for (const auto& span : spans)
+        {
+            for (int i = span.first; i <= span.last; ++i) table[i] = span.flags;
+        }
+        return table;
+    }
+
+    // Primary opcode map (64-bit mode)
+    constexpr auto ONE_BYTE = buildTable(None, {
+        // add/or/adc/sbb/and/sub/xor/cmp share the same layout every 8 opcodes
+        {0x00, 0x03, ModRM}, {0x04, 0x04, Imm8}, {0x05, 0x05, ImmZ}, {0x06, 0x07, Invalid},
+        {0x08, 0x0B, ModRM}, {0x0C, 0x0C, Imm8}, {0x0D, 0x0D, ImmZ}, {0x0E, 0x0E, Invalid},
+        {0x0F, 0x0F, Escape},
+        {0x10, 0x13, ModRM}, {0x14, 0x14, Imm8}, {0x15, 0x15, ImmZ}, {0x16, 0x17, Invalid},
+        {0x18, 0x1B, ModRM}, {0x1C, 0x1C, Imm8}, {0x1D, 0x1D, ImmZ}, {0x1E, 0x1F, Invalid},
+        {0x20, 0x23, ModRM}, {0x24, 0x24, Imm8}, {0x25, 0x25, ImmZ}, {0x26, 0x26, Prefix}, {0x27, 0x27, Invalid},
+        {0x28, 0x2B, ModRM}, {0x2C, 0x2C, Imm8}, {0x2D, 0x2D, ImmZ}, {0x2E, 0x2E, Prefix}, {0x2F, 0x2F, Invalid},
+        {0x30, 0x33, ModRM}, {0x34, 0x34, Imm8}, {0x35, 0x35, ImmZ}, {0x36, 0x36, Prefix}, {0x37, 0x37, Invalid},
+        {0x38, 0x3B, ModRM}, {0x3C, 0x3C, Imm8}, {0x3D, 0x3D, ImmZ}, {0x3E, 0x3E, Prefix}, {0x3F, 0x3F, Invalid},
+        {0x40, 0x4F, Prefix}, // REX
+        {0x60, 0x61, Invalid}, {0x62, 0x62, Vex}, {0x63, 0x63, ModRM},
+        {0x64, 0x67, Prefix},
+        {0x68, 0x68, ImmZ}, {0x69, 0x69, ModRM | ImmZ}, {0x6A, 0x6A, Imm8}, {0x6B, 0x6B, ModRM | Imm8},
+        {0x70, 0x7F, Rel8},
+        {0x80, 0x80, ModRM | Imm8}, {0x81, 0x81, ModRM | ImmZ}, {0x82, 0x82, Invalid}, {0x83, 0x83, ModRM | Imm8},
+        {0x84, 0x8F, ModRM},
+        {0x9A, 0x9A, Invalid},
+        {0xA0, 0xA3, Moffs}, {0xA8, 0xA8, Imm8}, {0xA9, 0xA9, ImmZ},
+        {0xB0, 0xB7, Imm8}, {0xB8, 0xBF, ImmV},
+        {0xC0, 0xC1, ModRM | Imm8}, {0xC2, 0xC2, Imm16}, {0xC4, 0xC5, Vex}, {0xC6, 0xC6, ModRM | Imm8},
+        {0xC7, 0xC7, ModRM | ImmZ}, {0xC8, 0xC8, Imm16 | Imm8}, {0xCA, 0xCA, Imm16}, {0xCD, 0xCD, Imm8},
+        {0xCE, 0xCE, Invalid},
+        {0xD0, 0xD3, ModRM}, {0xD4, 0xD6, Invalid}, {0xD8, 0xDF, ModRM},
+        {0xE0, 0xE3, Rel8}, {0xE4, 0xE7, Imm8}, {0xE8, 0xE9, RelZ}, {0xEA, 0xEA, Invalid}, {0xEB, 0xEB, Rel8},
+        {0xF0, 0xF0, Prefix}, {0xF2, 0xF3, Prefix},
+        {0xF6, 0xF7, ModRM | Group3}, {0xFE, 0xFF, ModRM},
+    });
+
+    // 0F xx
+    constexpr auto TWO_BYTE = buildTable(ModRM, {
+        {0x04, 0x04, Invalid}, {0x05, 0x09, None}, {0x0A, 0x0A, Invalid}, {0x0B, 0x0B, None},
+        {0x0C, 0x0C, Invalid}, {0x0E, 0x0E, None}, {0x0F, 0x0F, ModRM | Imm8},
+        {0x24, 0x27, Invalid}, {0x30, 0x37, None}, {0x38, 0x38, Escape}, {0x39, 0x39, Invalid},
+        {0x3A, 0x3A, Escape}, {0x3B, 0x3F, Invalid},
+        {0x70, 0x73, ModRM | Imm8}, {0x77, 0x77, None}, {0x7A, 0x7B, Invalid},
+        {0x80, 0x8F, RelZ},
+        {0xA0, 0xA2, None}, {0xA4, 0xA4, ModRM | Imm8}, {0xA6, 0xA7, Invalid}, {0xA8, 0xAA, None},
+        {0xAC, 0xAC, ModRM | Imm8}, {0xBA, 0xBA, ModRM | Imm8},
+        {0xC2, 0xC2, ModRM | Imm8}, {0xC4, 0xC6, ModRM | Imm8}, {0xC8, 0xCF, None},
+    });
+
+    // 0F 38 xx has no immediates, 0F 3A xx always takes an imm8
+    constexpr uint16_t THREE_BYTE_38 = ModRM;
+    constexpr uint16_t THREE_BYTE_3A = ModRM | Imm8;
+
+    int64_t readSigned(const uint8_t* field, size_t size)
+    {
+        switch (size)
+        {
+        case 1:
+            return static_cast<int8_t>(field[0]);
+        case 2:
+        {
+            int16_t value;
+            memcpy(&value, field, sizeof(value));
+            return value;
+        }
+        case 4:
+        {
+            int32_t value;
+            memcpy(&value, field, sizeof(value));
+            return value;
+        }
+        case 8:
+        {
+            int64_t value;
+            memcpy(&value, field, sizeof(value));
+            return value;
+        }
+        default:
+            return 0;
+        }
+    }
+
+    uint16_t flagsFor(uint8_t map, uint8_t opcode)
+    {
+        switch (map)
+        {
+        case 0:
+            return ONE_BYTE[opcode];
+        case 1:
+            return TWO_BYTE[opcode];
+        case 2:
+            return THREE_BYTE_38;
+        case 3:
+            return THREE_BYTE_3A;
+        default:
+            return Invalid;
+        }
+    }
+}
+
+bool X64Decoder::decode(const uint8_t* code, size_t available, Instruction& out)
+{
+    out = {};
+    if (!code || available == 0) return false;
+
+    const size_t limit = available < MAX_LENGTH ? available : MAX_LENGTH;
+    size_t pos = 0;
+
+    // Legacy prefixes, then at most one REX directly before the opcode
+    while (pos < limit)
+    {
+        const auto byte = code[pos];
+        if (!(ONE_BYTE[byte] & Prefix)) break;
+
+        if (byte >= 0x40 && byte <= 0x4F) out.rex = byte;
+        else
+        {
+            // A legacy prefix after REX cancels the REX
+            out.rex = 0;
+            if (byte == 0x66) out.operandSizePrefix = true;
+            if (byte == 0x67) out.addressSizePrefix = true;
+        }
+        ++pos;
+    }
+    if (pos >= limit) return false;
+
+    uint16_t flags;
+    const auto first = code[pos++];
+
+    if (ONE_BYTE[first] & Vex)
+    {
+        // C4: 3 byte VEX, C5: 2 byte VEX, 62: 4 byte EVEX. The map comes from the payload.
+        const size_t payload = first == 0xC5 ? 1 : first == 0xC4 ? 2 : 3;
+        if (pos + payload >= limit) return false;
+
+        uint8_t map = 1;
+        if (first == 0xC4) map = code[pos] & 0x1F;
+        else if (first == 0x62) map = code[pos] & 0x07;
+
+        // EVEX maps 5/6 (FP16) behave like 0F/0F38 for length purposes
+        if (first == 0x62 && map == 5) map = 1;
+        if (first == 0x62 && map == 6) map = 2;
+        if (map < 1 || map > 3) return false;
+
+        // W bit (REX.W equivalent) for immediate sizing
+        if (first != 0xC5 && (code[pos + 1] & 0x80)) out.rex = 0x48;
+
+        pos += payload;
+        out.vex = true;
+        out.map = map;
+        out.opcode = code[pos++];
+
+        // Every VEX/EVEX instruction has a ModRM except vzeroupper/vzeroall (0F 77)
+        flags = map == 1 && out.opcode == 0x77 ? None : (flagsFor(map, out.opcode) | ModRM);
+        flags &= ~(RelZ | Escape);
+    }
+    else if (first == 0x0F)
+    {
+        if (pos >= limit) return false;
+
+        const auto second = code[pos++];
+        if (second == 0x38 || second == 0x3A)
+        {
+            if (pos >= limit) return false;
+            out.map = second == 0x38 ? 2 : 3;
+            out.opcode = code[pos++];
+        }
+        else
+        {
+            out.map = 1;
+            out.opcode = second;
+        }
+        flags = flagsFor(out.map, out.opcode);
+    }
+    else
+    {
+        out.opcode = first;
+        flags = ONE_BYTE[first];
+    }
+
+    if (flags & Invalid) return false;
+
+    if (flags & ModRM)
+    {
+        if (pos >= limit) return false;
+
+        out.hasModRM = true;
+        out.modrm = code[pos++];
+
+        const uint8_t mod = out.modrm >> 6;
+        const uint8_t rm = out.modrm & 7;
+
+        if (mod != 3)
+        {
+            if (rm == 4)
+            {
+                if (pos >= limit) return false;
+                const auto sib = code[pos++];
+                if (mod == 0 && (sib & 7) == 5) out.dispSize = 4;
+            }
+            else if (mod == 0 && rm == 5)
+            {
+                out.dispSize = 4;
+                out.ripRelative = true;
+            }
+
+            if (mod == 1) out.dispSize = 1;
+            else if (mod == 2) out.dispSize = 4;
+        }
+
+        if (out.dispSize)
+        {
+            out.dispOffset = static_cast<uint8_t>(pos);
+            pos += out.dispSize;
+        }
+
+        // test r/m, imm is the only member of group 3 with an immediate
+        if ((flags & Group3) && ((out.modrm >> 3) & 7) < 2)
+            flags |= out.opcode == 0xF6 ? Imm8 : ImmZ;
+    }
+
+    const bool rexW = (out.rex & 0x08) != 0;
+    size_t immSize = 0;
+    if (flags & Imm8) immSize += 1;
+    if (flags & Imm16) immSize += 2;
+    if (flags & ImmZ) immSize += out.operandSizePrefix ? 2 : 4;
+    if (flags & ImmV) immSize += rexW ? 8 : out.operandSizePrefix ? 2 : 4;
+    if (flags & Moffs) immSize += out.addressSizePrefix ? 4 : 8;
+    if (flags & Rel8) immSize += 1;
+    if (flags & RelZ) immSize += 4;
+
+    if (immSize)
+    {
+        out.immOffset = static_cast<uint8_t>(pos);
+        out.immSize = static_cast<uint8_t>(immSize);
+        out.relative = (flags & (Rel8 | RelZ)) != 0;
+        pos += immSize;
+    }
+
+    if (pos > limit) return false;
+
+    out.length = static_cast<uint8_t>(pos);
+    return true;
+}
+
+int64_t X64Decoder::displacement(const uint8_t* code, const Instruction& instruction)
+{
+    return readSigned(code + instruction.dispOffset, instruction.dispSize);
+}
+
+int64_t X64Decoder::immediate(const uint8_t* code, const Instruction& instruction)
+{
+    // enter (iw, ib) is the only instruction with two immediates, report the first
+    const auto size = instruction.immSize == 3 ? 2 : instruction.immSize;
+    return readSigned(code + instruction.immOffset, size);
+}
+
+uintptr_t X64Decoder::target(const uint8_t* code, const Instruction& instruction, uintptr_t address)
+{
+    // Both are relative to the start of the next instruction
+    const auto next = address + instruction.length;
+
+    if (instruction.ripRelative) return next + displacement(code, instruction);
+    if (instruction.relative) return next + immediate(code, instruction);
+    return 0;
+}
@@ -0,0 +1,47 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Table-driven x86-64 instruction length decoder. Works on plain byte buffers and never reads past
+// 'available', so it is safe on arbitrary input.
+class X64Decoder
+{
+public:
+    struct Instruction
+    {
+        uint8_t length = 0;
+        uint8_t opcode = 0; // last opcode byte
+        uint8_t map = 0;    // 0 = one byte, 1 = 0F, 2 = 0F 38, 3 = 0F 3A
+        uint8_t rex = 0;
+        uint8_t modrm = 0;
+        bool hasModRM = false;
+        bool operandSizePrefix = false; // 66
+        bool addressSizePrefix = false; // 67
+        bool vex = false;               // VEX or EVEX encoded
+
+        // Location of the displacement / immediate inside the instruction, size 0 if absent
+        uint8_t dispOffset = 0;
+        uint8_t dispSize = 0;
+        uint8_t immOffset = 0;
+        uint8_t immSize = 0;
+
+        bool ripRelative = false; // memory operand is [rip + disp32]
+        bool relative = false;    // the immediate is a branch displacement (jmp/call/jcc rel)
+    };
+
+    // Returns false if the bytes are not a valid instruction or it does not fit in 'available'
+    static bool decode(const uint8_t* code, size_t available, Instruction& out);
+
+    // Absolute address an instruction refers to: the [rip + disp32] operand, or the destination of a
+    // relative jmp/call/jcc/loop. 'address' is where the instruction runs; for a loaded module that is
+    // 'code' itself, for an offline image it can be the preferred base address. Returns 0 if neither is
+    // present.
+    static uintptr_t target(const uint8_t* code, const Instruction& instruction, uintptr_t address);
+
+    // Sign extended value of the displacement or immediate field
+    static int64_t displacement(const uint8_t* code, const Instruction& instruction);
+    static int64_t immediate(const uint8_t* code, const Instruction& instruction);
+
+    static constexpr size_t MAX_LENGTH = 15;
+};
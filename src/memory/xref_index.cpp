@@ -0,0 +1,244 @@
+﻿#include "pch.h"
+#include "xref_index.h"
+
+#include "scanner.h"
+#include "scanner_kernels.h"
+#include "string_index.h"
+#include "x64_decoder.h"
+#include "utils/thread_pool.h"
+
+namespace
+{
+    bool isCandidate(uint8_t byte)
+    {
+        // call/jmp rel32, or a ModRM byte with mod = 00 and rm = 101 ([rip + disp32])
+        return byte == 0xE8 || byte == 0xE9 || (byte & 0xC7) == 0x05;
+    }
+
+    template <typename Visit>
+    const uint8_t* candidatesSSE2(const uint8_t* current, const uint8_t* end, Visit&& visit)
+    {
+        const auto e8 = _mm_set1_epi8(static_cast<char>(0xE8));
+        const auto e9 = _mm_set1_epi8(static_cast<char>(0xE9));
+        const auto modrmMask = _mm_set1_epi8(static_cast<char>(0xC7));
+        const auto modrmRip = _mm_set1_epi8(0x05);
+
+        for (; current + 16 <= end; current += 16)
+        {
+            const auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(current));
+            const auto branch = _mm_or_si128(_mm_cmpeq_epi8(bytes, e8), _mm_cmpeq_epi8(bytes, e9));
+            const auto rip = _mm_cmpeq_epi8(_mm_and_si128(bytes, modrmMask), modrmRip);
+
+            const auto mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_or_si128(branch, rip)));
+            if (mask) visit(current, mask);
+        }
+        return current;
+    }
+
+    template <typename Visit>
+    SCANNER_TARGET_AVX2 const uint8_t* candidatesAVX2(const uint8_t* current, const uint8_t* end, Visit&& visit)
+    {
+        const auto e8 = _mm256_set1_epi8(static_cast<char>(0xE8));
+        const auto e9 = _mm256_set1_epi8(static_cast<char>(0xE9));
+        const auto modrmMask = _mm256_set1_epi8(static_cast<char>(0xC7));
+        const auto modrmRip = _mm256_set1_epi8(0x05);
+
+        for (; current + 32 <= end; current += 32)
+        {
+            const auto bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(current));
+            const auto branch = _mm256_or_si256(_mm256_cmpeq_epi8(bytes, e8), _mm256_cmpeq_epi8(bytes, e9));
+            const auto rip = _mm256_cmpeq_epi8(_mm256_and_si256(bytes, modrmMask), modrmRip);
+
+            const auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(branch, rip)));
+            if (mask) visit(current, mask);
+        }
+        return current;
+    }
+
+    // Decodes at 'start' and checks that 'modrm' really is the ModRM byte of a [rip + disp32] operand
+    bool decodesAsRipRelative(const uint8_t* start, const uint8_t* modrm, const uint8_t* rangeEnd,
+                              X64Decoder::Instruction& instruction)
+    {
+        return X64Decoder::decode(start, static_cast<size_t>(rangeEnd - start), instruction) &&
+            instruction.ripRelative && start + instruction.dispOffset == modrm + 1;
+    }
+}
+
+XrefIndex::XrefIndex(uintptr_t module)
+    : m_module(module)
+{
+    const PeImage image(module);
+    if (!image.valid()) return;
+
+    m_size = image.sizeOfImage();
+    m_code = image.ranges(SectionKind::Code);
+
+    m_functions = &FunctionIndex::forModule(module);
+
+    // Chunks only own the candidates in [begin, end), decoding may read up to the end of the section
+    const auto chunks = Scanner::splitChunks(m_code, 0);
+    std::vector<std::vector<Xref>> found(chunks.size());
+
+    ThreadPool::getInstance().parallelFor(chunks.size(), [&](size_t index)
+    {
+        const auto& chunk = chunks[index];
+        const auto range = std::ranges::find_if(m_code, [&chunk](const PeImage::Range& code)
+        {
+            return chunk.begin >= code.begin && chunk.begin < code.end;
+        });
+        scanChunk(range->begin, range->end, chunk.begin, chunk.end, found[index]);
+    });
+
+    size_t total = 0;
+    for (const auto& xrefs : found) total += xrefs.size();
+    m_xrefs.reserve(total);
+    for (auto& xrefs : found) m_xrefs.insert(m_xrefs.end(), xrefs.begin(), xrefs.end());
+
+    std::ranges::sort(m_xrefs, [](const Xref& a, const Xref& b)
+    {
+        return a.target != b.target ? a.target < b.target : a.site < b.site;
+    });
+
+    for (size_t i = 0; i < m_xrefs.size();)
+    {
+        auto j = i;
+        while (j < m_xrefs.size() && m_xrefs[j].target == m_xrefs[i].target) ++j;
+        m_lookup.emplace(m_xrefs[i].target, std::make_pair(static_cast<uint32_t>(i), static_cast<uint32_t>(j - i)));
+        i = j;
+    }
+
+    m_valid = true;
+}
+
+void XrefIndex::scanChunk(const uint8_t* rangeBegin, const uint8_t* rangeEnd, const uint8_t* begin,
+                          const uint8_t* end, std::vector<Xref>& out) const
+{
+    const auto visit = [&](const uint8_t* block, uint32_t mask)
+    {
+        while (mask)
+        {
+            inspect(rangeBegin, rangeEnd, block + scanner_detail::countTrailingZeros(mask), out);
+            mask &= mask - 1;
+        }
+    };
+
+    auto current = begin;
+    if (Scanner::activeBackend() == Scanner::Backend::AVX2) current = candidatesAVX2(current, end, visit);
+    current = candidatesSSE2(current, end, visit);
+
+    for (; current < end; ++current)
+    {
+        if (isCandidate(*current)) inspect(rangeBegin, rangeEnd, current, out);
+    }
+}
+
+void XrefIndex::inspect(const uint8_t* rangeBegin, const uint8_t* rangeEnd, const uint8_t* candidate,
+                        std::vector<Xref>& out) const
+{
+    const auto byte = *candidate;
+
+    if (byte == 0xE8 || byte == 0xE9)
+    {
+        if (rangeEnd - candidate < 5) return;
+
+        int32_t displacement;
+        memcpy(&displacement, candidate + 1, sizeof(displacement));
+
+        const auto site = reinterpret_cast<uintptr_t>(candidate);
+        const auto target = site + 5 + displacement;
+        if (isCode(target)) out.push_back({site, target, byte == 0xE8 ? Kind::Call : Kind::Jump});
+        return;
+    }
+
+    // The candidate is a ModRM byte, find where its instruction starts. VEX/EVEX first since their
+    // payload bytes could otherwise be mistaken for a legacy opcode.
+    X64Decoder::Instruction instruction;
+    const uint8_t* start = nullptr;
+
+    const auto available = static_cast<size_t>(candidate - rangeBegin);
+    const auto tryStart = [&](size_t back, uint8_t lead)
+    {
+        if (start || available < back || candidate[-static_cast<ptrdiff_t>(back)] != lead) return;
+
+        const auto at = candidate - back;
+        if (decodesAsRipRelative(at, candidate, rangeEnd, instruction)) start = at;
+    };
+
+    tryStart(5, 0x62); // EVEX
+    tryStart(4, 0xC4); // 3 byte VEX
+    tryStart(3, 0xC5); // 2 byte VEX
+
+    if (!start)
+    {
+        // Legacy opcode: 0F 38 xx / 0F 3A xx, 0F xx, or a single byte
+        const uint8_t* opcode = candidate - 1;
+        if (available >= 3 && candidate[-3] == 0x0F && (candidate[-2] == 0x38 || candidate[-2] == 0x3A))
+            opcode = candidate - 3;
+        else if (available >= 2 && candidate[-2] == 0x0F)
+            opcode = candidate - 2;
+        if (available < 1) return;
+
+        // Then at most one REX and a few legacy prefixes (66/F2/F3 are also SSE mandatory prefixes)
+        auto prefixed = opcode;
+        if (prefixed > rangeBegin && (prefixed[-1] & 0xF0) == 0x40) --prefixed;
+        while (prefixed > rangeBegin && opcode - prefixed < 4 &&
+            (prefixed[-1] == 0x66 || prefixed[-1] == 0xF2 || prefixed[-1] == 0xF3))
+            --prefixed;
+
+        if (prefixed != opcode && decodesAsRipRelative(prefixed, candidate, rangeEnd, instruction)) start = prefixed;
+        else if (decodesAsRipRelative(opcode, candidate, rangeEnd, instruction)) start = opcode;
+        else return;
+    }
+
+    const auto site = reinterpret_cast<uintptr_t>(start);
+    const auto target = X64Decoder::target(start, instruction, site);
+    if (inImage(target)) out.push_back({site, target, Kind::RipRelative});
+}
+
+bool XrefIndex::isCode(uintptr_t address) const
+{
+    const auto pointer = reinterpret_cast<const uint8_t*>(address);
+    return std::ranges::any_of(m_code, [pointer](const PeImage::Range& range)
+    {
+        return pointer >= range.begin && pointer < range.end;
+    });
+}
+
+std::span<const XrefIndex::Xref> XrefIndex::referencesTo(uintptr_t target) const
+{
+    const auto it = m_lookup.find(target);
+    if (it == m_lookup.end()) return {};
+    return std::span(m_xrefs).subspan(it->second.first, it->second.second);
+}
+
+uintptr_t XrefIndex::functionContaining(uintptr_t address) const
+{
+    return m_functions ? m_functions->functionStart(address) : 0;
+}
+
+std::vector<uintptr_t> XrefIndex::functionsReferencing(uintptr_t target) const
+{
+    std::vector<uintptr_t> functions;
+    for (const auto& xref : referencesTo(target))
+    {
+        if (const auto function = functionContaining(xref.site)) functions.push_back(function);
+    }
+
+    std::ranges::sort(functions);
+    functions.erase(std::ranges::unique(functions).begin(), functions.end());
+    return functions;
+}
+
+std::vector<uintptr_t> XrefIndex::functionsReferencing(const StringIndex& strings, std::string_view text) const
+{
+    std::vector<uintptr_t> functions;
+    for (const auto address : strings.find(text))
+    {
+        const auto found = functionsReferencing(address);
+        functions.insert(functions.end(), found.begin(), found.end());
+    }
+
+    std::ranges::sort(functions);
+    functions.erase(std::ranges::unique(functions).begin(), functions.end());
+    return functions;
+}
@@ -0,0 +1,72 @@
+﻿#pragma once
+
+#include "function_index.h"
+#include "pe_image.h"
+
+#include <span>
+#include <unordered_map>
+
+class StringIndex;
+
+// Reverse index from addresses to the instructions referencing them (call/jmp rel32 and [rip + disp32]
+// operands), built in one pass over the executable sections. Candidate bytes (E8, E9 and the
+// RIP-relative ModRM form) are found 16/32 at a time with SIMD and only those are decoded. Call and
+// jump targets must land in code and RIP-relative targets inside the image, which filters out almost
+// all bytes that merely look like an instruction. A RIP-relative site can start one byte early when the
+// previous instruction ends in a byte that also reads as a prefix (REX, 66, F2, F3), the target is unaffected.
+//
+//   const XrefIndex xrefs(module);
+//   const StringIndex strings(module);
+//   for (const auto function : xrefs.functionsReferencing(strings, "Failed to load %s")) ...
+class XrefIndex
+{
+public:
+    enum class Kind : uint8_t
+    {
+        Call,        // call rel32
+        Jump,        // jmp rel32
+        RipRelative  // any instruction with a [rip + disp32] operand (lea, mov, cmp, SSE...)
+    };
+
+    struct Xref
+    {
+        uintptr_t site;   // address of the referencing instruction
+        uintptr_t target;
+        Kind kind;
+    };
+
+    explicit XrefIndex(uintptr_t module);
+
+    _NODISCARD bool valid() const { return m_valid; }
+    _NODISCARD size_t size() const { return m_xrefs.size(); }
+
+    // References to 'target', sorted by site. A hash lookup once the index is built.
+    _NODISCARD std::span<const Xref> referencesTo(uintptr_t target) const;
+
+    // Entry point of the function containing 'address' (see FunctionIndex), 0 if it is not inside one
+    _NODISCARD uintptr_t functionContaining(uintptr_t address) const;
+
+    // Functions referencing any copy of the string, sorted and without duplicates
+    _NODISCARD std::vector<uintptr_t> functionsReferencing(const StringIndex& strings, std::string_view text) const;
+    _NODISCARD std::vector<uintptr_t> functionsReferencing(uintptr_t target) const;
+
+private:
+    void scanChunk(const uint8_t* rangeBegin, const uint8_t* rangeEnd, const uint8_t* begin, const uint8_t* end,
+                   std::vector<Xref>& out) const;
+    void inspect(const uint8_t* rangeBegin, const uint8_t* rangeEnd, const uint8_t* candidate,
+                 std::vector<Xref>& out) const;
+
+    _NODISCARD bool isCode(uintptr_t address) const;
+    _NODISCARD bool inImage(uintptr_t address) const { return address >= m_module && address < m_module + m_size; }
+
+    uintptr_t m_module;
+    size_t m_size = 0;
+    bool m_valid = false;
+    std::vector<PeImage::Range> m_code;
+
+    // Grouped by target, m_lookup maps a target to its [first, first + count) slice of m_xrefs
+    std::vector<Xref> m_xrefs;
+    std::unordered_map<uintptr_t, std::pair<uint32_t, uint32_t>> m_lookup;
+
+    const FunctionIndex* m_functions = nullptr;
+};
@@ -8,6 +8,32 @@
 #define PCH_H
 
 // add headers that you want to pre-compile here
+#ifdef _WIN32
 #include "framework.h"
+#else
+// Portable subset for the Linux build in CMakeLists.txt (memory library, events, benchmarks and tests),
+// without the Windows, Unity and ImGui dependencies of framework.h
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#ifndef _NODISCARD
+#define _NODISCARD [[nodiscard]]
+#endif
+
+#include "utils/logger.h"
+#endif
 
 #endif //PCH_H
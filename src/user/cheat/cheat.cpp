@@ -4,6 +4,7 @@
 #include "feature_manager.h"
 
 #include "memory/mem.h"
+#include "memory/signature_cache.h"
 
 namespace cheat
 {
@@ -57,38 +58,43 @@ namespace cheat
 
     void hookMonoBehaviour(uintptr_t unity, int versionMajor)
     {
-        auto signature = "";
+        // Each case resolves its own literal so the scan is specialized on the signature length.
+        // Results are cached on disk per UnityPlayer.dll build, an unchanged game skips the scan.
+        const auto scan = [unity](const auto& signature)
+        {
+            return SignatureCache::getInstance().resolve(unity, signature);
+        };
+
+        uintptr_t address = 0;
         switch (versionMajor)
         {
         case 2017:
-            signature = "48 89 5c 24 ? 57 48 83 ec ? 48 8b 41 ? 8b fa 48 8b d9 48 85 c0 74 ? 80 78";
+            address = scan("48 89 5c 24 ? 57 48 83 ec ? 48 8b 41 ? 8b fa 48 8b d9 48 85 c0 74 ? 80 78"_sig);
             break;
         case 2018:
-            signature = "48 89 5c 24 ? 57 48 83 ec ? 48 8b 81 ? ? ? ? 8b fa 48 8b d9 48 85 c0 74 ? 80 78";
+            address = scan("48 89 5c 24 ? 57 48 83 ec ? 48 8b 81 ? ? ? ? 8b fa 48 8b d9 48 85 c0 74 ? 80 78"_sig);
             break;
         case 2019:
-            signature = "48 89 5c 24 ? 56 48 83 ec ? 48 8b 81 ? ? ? ? 8b f2";
+            address = scan("48 89 5c 24 ? 56 48 83 ec ? 48 8b 81 ? ? ? ? 8b f2"_sig);
             break;
         case 2020:
         case 2021:
-            signature = "48 89 5c 24 ? 57 48 83 ec ? 48 8b 81 ? ? ? ? 8b fa 48 8b d9 48 85 c0 74 ? 80 78";
+            address = scan("48 89 5c 24 ? 57 48 83 ec ? 48 8b 81 ? ? ? ? 8b fa 48 8b d9 48 85 c0 74 ? 80 78"_sig);
             break;
         case 2022:
-            signature = "48 89 74 24 ? 57 48 83 ec ? 8b f2 48 8b f9 e8 ? ? ? ? 84 c0";
+            address = scan("48 89 74 24 ? 57 48 83 ec ? 8b f2 48 8b f9 e8 ? ? ? ? 84 c0"_sig);
             break;
         case 2023:
         case 6000:
-            signature = "48 89 5c 24 ? 56 48 83 ec ? 8b f2 48 8b d9 e8 ? ? ? ? 84 c0 0f 85";
+            address = scan("48 89 5c 24 ? 56 48 83 ec ? 8b f2 48 8b d9 e8 ? ? ? ? 84 c0 0f 85"_sig);
             break;
         default:
             LOG_WARN("Signature for MonoBehaviour::CallUpdateMethod not set for Unity version major {}", versionMajor);
-            break;
+            return;
         }
 
-        if (!signature || strlen(signature) == 0) return;
-
         using CallUpdateMethod_t = void(*)(void*, MethodIndex);
-        auto func = reinterpret_cast<CallUpdateMethod_t>(Mem::patternScan(unity, signature));
+        auto func = reinterpret_cast<CallUpdateMethod_t>(address);
         if (!func)
         {
             LOG_ERROR("MonoBehaviour::CallUpdateMethod not found! Signature is probably incorrect.");
@@ -97,6 +103,6 @@ namespace cheat
 
         // LOG_DEBUG("Found MonoBehaviour::CallUpdateMethod at {:p}", reinterpret_cast<void*>(func));
 
-        HookManager::install(func, CallUpdateMethod_Hook);
+        HookManager::install<CallUpdateMethod_Hook>(func);
     }
 }
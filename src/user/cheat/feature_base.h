@@ -3,6 +3,7 @@
 #include "core/config/config_object.h"
 #include "core/config/fields/field.h"
 #include "core/config/fields/hotkey_field.h"
+#include "memory/hook_manager.h"
 #include "utils/singleton.h"
 
 #define CONFIG_FIELD(TYPE, NAME, DEFAULT) config::Field<TYPE> NAME{this->getPath(), #NAME, DEFAULT}
@@ -47,9 +48,15 @@ namespace cheat
                 if (newE != oldE)
                 {
                     if (newE)
+                    {
+                        setHooksEnabled(true);
                         onEnable();
+                    }
                     else
+                    {
                         onDisable();
+                        setHooksEnabled(false);
+                    }
                 }
             });
 
@@ -103,6 +110,7 @@ namespace cheat
         void setupConfig()
         {
             this->load();
+            setHooksEnabled(m_enabled.get());
             if (m_enabled.get()) onEnable();
         }
 
@@ -131,6 +139,21 @@ namespace cheat
         }
 
     protected:
+        // Hooks that only matter while the feature is on. They follow the enabled state from here on, all
+        // hooks of the feature are toggled in one HookManager batch. Call after setting the detours:
+        //   Player::Update_Hook().set(&onUpdate);
+        //   ownHooks(Player::Update_Hook());
+        template <typename... Hooks>
+        void ownHooks(Hooks&... hooks)
+        {
+            (m_ownedHooks.push_back({&hooks, [](void* hook, bool enabled)
+            {
+                static_cast<Hooks*>(hook)->enable(enabled);
+            }}), ...);
+
+            setHooksEnabled(isEnabled());
+        }
+
         std::string m_name;
         std::string m_description;
         FeatureSection m_section;
@@ -144,6 +167,27 @@ namespace cheat
         config::Field<bool>::Connection m_enabledChangedConnection;
         config::HotkeyField::Connection m_toggleKeyConnection;
 
+        struct OwnedHook
+        {
+            void* hook;
+            void (*setEnabled)(void*, bool);
+        };
+
+        std::vector<OwnedHook> m_ownedHooks;
+
+        void setHooksEnabled(bool enabled)
+        {
+            if (m_ownedHooks.empty()) return;
+
+            // Inside a batch this thread opened (enabling several features at once) the changes join it,
+            // another thread's batch is waited for
+            HookManager::ScopedBatch batch;
+
+            for (const auto& owned : m_ownedHooks) owned.setEnabled(owned.hook, enabled);
+
+            if (!batch.commit()) LOG_ERROR("Failed to {} the hooks of {}", enabled ? "enable" : "disable", m_name);
+        }
+
         // Could use magic_enum but we'll see later
         static const char* getSectionNameForSection(const FeatureSection section)
         {
@@ -3,6 +3,7 @@
 
 #include "core/rendering/renderer.h"
 #include "cheat/cheat.h"
+#include "utils/thread_pool.h"
 
 void Main::run()
 {
@@ -35,6 +36,7 @@ void Main::shutdown()
 
     Renderer::getInstance().shutdown();
     cheat::shutdown();
+    ThreadPool::getInstance().shutdown();
     Sleep(100);
     Logger::close();
 }
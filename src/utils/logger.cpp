@@ -1,6 +1,8 @@
 ﻿#include "pch.h"
 #include "logger.h"
 
+#include <iostream>
+
 void Logger::writeLog(const char* file, int line, LogLevel level, const std::string& message)
 {
     if (m_excludedLevels.contains(level)) return;
@@ -155,7 +157,7 @@ void Logger::closeFileLogging()
     }
 }
 
-void Logger::writeToConsole(const std::string& formattedMessage, LogLevel level)
+void Logger::writeToConsole(const std::string& formattedMessage, [[maybe_unused]] LogLevel level)
 {
 #ifdef _WIN32
     if (m_enableColors)
@@ -11,11 +11,11 @@
 #include <Windows.h>
 #endif
 
-#define LOG(fmt, ...)       Logger::log(__FILE__, __LINE__, LogLevel::Info, fmt, __VA_ARGS__)
-#define LOG_INFO(fmt, ...)  Logger::log(__FILE__, __LINE__, LogLevel::Info, fmt, __VA_ARGS__)
-#define LOG_DEBUG(fmt, ...) Logger::log(__FILE__, __LINE__, LogLevel::Debug, fmt, __VA_ARGS__)
-#define LOG_ERROR(fmt, ...) Logger::log(__FILE__, __LINE__, LogLevel::Error, fmt, __VA_ARGS__)
-#define LOG_WARN(fmt, ...)  Logger::log(__FILE__, __LINE__, LogLevel::Warning, fmt, __VA_ARGS__)
+#define LOG(fmt, ...)       Logger::log(__FILE__, __LINE__, LogLevel::Info, fmt, ##__VA_ARGS__)
+#define LOG_INFO(fmt, ...)  Logger::log(__FILE__, __LINE__, LogLevel::Info, fmt, ##__VA_ARGS__)
+#define LOG_DEBUG(fmt, ...) Logger::log(__FILE__, __LINE__, LogLevel::Debug, fmt, ##__VA_ARGS__)
+#define LOG_ERROR(fmt, ...) Logger::log(__FILE__, __LINE__, LogLevel::Error, fmt, ##__VA_ARGS__)
+#define LOG_WARN(fmt, ...)  Logger::log(__FILE__, __LINE__, LogLevel::Warning, fmt, ##__VA_ARGS__)
 
 enum class LogLevel
 {
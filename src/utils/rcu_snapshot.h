@@ -0,0 +1,154 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Read-mostly value with copy-on-write updates. Readers pin the current snapshot with one atomic
+// increment and decrement, never block and never allocate. Writers copy the snapshot, publish the
+// modified copy and retire the replaced one. Writers never wait for readers, so updating from inside a
+// read section (a listener removing itself) is fine.
+//
+// Readers register in one of two counters, picked by the parity of m_epoch. A writer moves the epoch
+// on whenever the counter of the previous epoch has drained, and a snapshot retired two epochs ago can't
+// be held by anyone anymore. Retired snapshots are thus freed as soon as every read section that was
+// running when they were replaced has ended, even if readers never all leave at the same moment. This
+// happens in update(), so the last few retired snapshots wait for the next update or the destructor.
+// Each counter is split over cache line sized blocks picked per thread, so readers on different threads
+// don't contend for one line.
+template <typename T>
+class RcuSnapshot
+{
+public:
+    class ReadGuard
+    {
+    public:
+        explicit ReadGuard(const RcuSnapshot& owner)
+        {
+            // Registering under an epoch that moved on meanwhile would let a writer miss this reader
+            for (;;)
+            {
+                const auto epoch = owner.m_epoch.load(std::memory_order_seq_cst);
+                m_readers = &owner.m_readers[epoch & 1][readerStripe()].value;
+                m_readers->fetch_add(1, std::memory_order_seq_cst);
+                if (owner.m_epoch.load(std::memory_order_seq_cst) == epoch) break;
+                m_readers->fetch_sub(1, std::memory_order_release);
+            }
+            m_value = owner.m_current.load(std::memory_order_seq_cst);
+        }
+
+        ~ReadGuard() { m_readers->fetch_sub(1, std::memory_order_release); }
+
+        ReadGuard(const ReadGuard&) = delete;
+        ReadGuard& operator=(const ReadGuard&) = delete;
+
+        const T& operator*() const { return *m_value; }
+        const T* operator->() const { return m_value; }
+
+    private:
+        std::atomic<uint32_t>* m_readers;
+        const T* m_value;
+    };
+
+    RcuSnapshot()
+        : m_current(new T())
+    {
+    }
+
+    ~RcuSnapshot()
+    {
+        delete m_current.load();
+        for (const auto& retired : m_retired) delete retired.value;
+    }
+
+    RcuSnapshot(const RcuSnapshot&) = delete;
+    RcuSnapshot& operator=(const RcuSnapshot&) = delete;
+
+    _NODISCARD ReadGuard read() const { return ReadGuard(*this); }
+
+    // Applies 'mutate' to a copy of the current value and publishes it
+    template <typename Fn>
+    void update(Fn&& mutate)
+    {
+        std::lock_guard lock(m_writeMutex);
+
+        auto next = std::make_unique<T>(*m_current.load(std::memory_order_relaxed));
+        mutate(*next);
+
+        const auto previous = m_current.exchange(next.release(), std::memory_order_seq_cst);
+        m_retired.push_back({previous, m_epoch.load(std::memory_order_relaxed)});
+
+        reclaim();
+    }
+
+    // Snapshots replaced but not freed yet, a reader still inside an old read section holds them back
+    _NODISCARD size_t retiredCount() const
+    {
+        std::lock_guard lock(m_writeMutex);
+        return m_retired.size();
+    }
+
+    static constexpr size_t READER_STRIPES = 8;
+
+private:
+    struct alignas(64) ReaderCount
+    {
+        std::atomic<uint32_t> value{0};
+    };
+
+    // Counter block of the calling thread, threads are spread over the blocks round-robin
+    static size_t readerStripe()
+    {
+        static std::atomic<size_t> next{0};
+        thread_local const size_t stripe = next.fetch_add(1, std::memory_order_relaxed) % READER_STRIPES;
+        return stripe;
+    }
+
+    // Called with m_writeMutex held. A guard decrements the block it incremented, so no block goes
+    // below zero and the epoch is drained when all of its blocks are.
+    _NODISCARD bool drained(uint64_t epoch) const
+    {
+        return std::ranges::all_of(m_readers[epoch & 1], [](const ReaderCount& readers)
+        {
+            return readers.value.load(std::memory_order_seq_cst) == 0;
+        });
+    }
+
+    struct Retired
+    {
+        const T* value;
+        uint64_t epoch; // epoch it was replaced in
+    };
+
+    // Called with m_writeMutex held
+    void reclaim()
+    {
+        // Up to two steps: readers of the previous epoch are gone, so new ones can take over its counter,
+        // which then leaves only readers of the current epoch
+        for (int step = 0; step < 2; ++step)
+        {
+            const auto epoch = m_epoch.load(std::memory_order_relaxed);
+            if (!drained(epoch + 1)) break;
+            m_epoch.store(epoch + 1, std::memory_order_seq_cst);
+        }
+
+        // Every reader registered in the current or the previous epoch, both of which began after
+        // anything retired before the previous one was replaced, and loaded m_current after that
+        const auto epoch = m_epoch.load(std::memory_order_relaxed);
+        std::erase_if(m_retired, [epoch](const Retired& retired)
+        {
+            if (retired.epoch + 2 > epoch) return false;
+            delete retired.value;
+            return true;
+        });
+    }
+
+    std::atomic<const T*> m_current;
+    std::atomic<uint64_t> m_epoch{0};
+    mutable ReaderCount m_readers[2][READER_STRIPES];
+
+    mutable std::mutex m_writeMutex;
+    std::vector<Retired> m_retired;
+};
@@ -0,0 +1,136 @@
+﻿#include "pch.h"
+#include "thread_pool.h"
+
+ThreadPool& ThreadPool::getInstance()
+{
+    static ThreadPool instance;
+    return instance;
+}
+
+ThreadPool::ThreadPool()
+    : m_workerCount((std::max)(1u, std::thread::hardware_concurrency()) - 1)
+{
+}
+
+ThreadPool::~ThreadPool()
+{
+    // Nothing to wait for if the workers never started or shutdown() already stopped them
+    if (!m_workers.empty()) shutdown();
+}
+
+void ThreadPool::shutdown()
+{
+    {
+        std::unique_lock lock(m_mutex);
+        m_stopping = true;
+        m_wake.notify_all();
+
+        // Leaving the loop is all a worker does under our control, the rest of its exit may need the
+        // loader lock, so on Windows it is waited for here instead of with join()
+        m_done.wait(lock, [this] { return m_running == 0; });
+    }
+
+    for (auto& worker : m_workers)
+    {
+#ifdef _WIN32
+        worker.detach();
+#else
+        worker.join();
+#endif
+    }
+    m_workers.clear();
+}
+
+void ThreadPool::start()
+{
+    if (!m_workers.empty() || m_workerCount == 0 || m_stopping) return;
+
+    m_running = m_workerCount;
+    m_workers.reserve(m_workerCount);
+    for (size_t i = 0; i < m_workerCount; ++i) m_workers.emplace_back(&ThreadPool::workerLoop, this);
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& task)
+{
+    if (count == 0) return;
+
+    // Not worth waking anyone for a single item
+    if (count == 1 || m_workerCount == 0)
+    {
+        for (size_t i = 0; i < count; ++i) task(i);
+        return;
+    }
+
+    // One job at a time; nested parallelFor calls from inside a task would deadlock, run them inline
+    std::unique_lock submitLock(m_submitMutex, std::try_to_lock);
+    if (!submitLock.owns_lock())
+    {
+        for (size_t i = 0; i < count; ++i) task(i);
+        return;
+    }
+
+    Job job;
+    job.task = &task;
+    job.count = count;
+
+    {
+        std::lock_guard lock(m_mutex);
+        start();
+        m_job = &job;
+        ++m_generation;
+    }
+    m_wake.notify_all();
+
+    runJob(job);
+
+    std::unique_lock lock(m_mutex);
+    m_done.wait(lock, [this, &job] { return job.finished.load() == job.count && m_active == 0; });
+    m_job = nullptr;
+}
+
+void ThreadPool::workerLoop()
+{
+    uint64_t seen = 0;
+    while (true)
+    {
+        Job* job;
+        {
+            std::unique_lock lock(m_mutex);
+            m_wake.wait(lock, [this, seen] { return m_stopping || (m_job && m_generation != seen); });
+            if (m_stopping)
+            {
+                --m_running;
+                m_done.notify_all();
+                return;
+            }
+
+            seen = m_generation;
+            job = m_job;
+            ++m_active;
+        }
+
+        runJob(*job);
+
+        // The job lives on the submitter's stack, it may only return once nobody references it
+        std::lock_guard lock(m_mutex);
+        if (--m_active == 0) m_done.notify_all();
+    }
+}
+
+void ThreadPool::runJob(Job& job)
+{
+    size_t completed = 0;
+    for (auto index = job.next.fetch_add(1); index < job.count; index = job.next.fetch_add(1))
+    {
+        (*job.task)(index);
+        ++completed;
+    }
+
+    if (completed == 0) return;
+
+    if (job.finished.fetch_add(completed) + completed == job.count)
+    {
+        std::lock_guard lock(m_mutex);
+        m_done.notify_all();
+    }
+}
@@ -0,0 +1,57 @@
+﻿#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Small fixed-size worker pool for splitting CPU bound work (e.g. memory scans) across cores.
+// Workers are started lazily on first use.
+class ThreadPool
+{
+public:
+    static ThreadPool& getInstance();
+
+    // Runs task(0..count-1) across the pool and the calling thread, returns when all are done
+    void parallelFor(size_t count, const std::function<void(size_t)>& task);
+
+    _NODISCARD size_t workerCount() const { return m_workerCount; }
+
+    // Stops the workers, later parallelFor calls run on the calling thread. Call on unload before the
+    // loader detaches the DLL: the destructor runs under the loader lock, where a worker can't exit.
+    void shutdown();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+private:
+    ThreadPool();
+    ~ThreadPool();
+
+    struct Job
+    {
+        const std::function<void(size_t)>* task = nullptr;
+        size_t count = 0;
+        std::atomic<size_t> next{0};
+        std::atomic<size_t> finished{0};
+    };
+
+    void start();
+    void workerLoop();
+    void runJob(Job& job);
+
+    size_t m_workerCount;
+    std::vector<std::thread> m_workers;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    std::mutex m_submitMutex;
+
+    Job* m_job = nullptr;
+    size_t m_active = 0;
+    size_t m_running = 0; // workers still inside workerLoop
+    uint64_t m_generation = 0;
+    bool m_stopping = false;
+};
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdio>
+
+// Minimal checks shared by the tests: CHECK reports a failed condition and carries on, main() ends with
+// return testResult();
+
+#define CHECK(condition)                                                         \
+    do                                                                           \
+    {                                                                            \
+        if (!(condition))                                                        \
+        {                                                                        \
+            std::printf("FAILED %s:%d: %s\n", __FILE__, __LINE__, #condition);   \
+            ++g_failures;                                                        \
+        }                                                                        \
+    } while (false)
+
+inline int g_failures = 0;
+
+// Exit code of the test, prints how many checks failed
+inline int testResult()
+{
+    if (g_failures) std::printf("%d checks failed\n", g_failures);
+    return g_failures ? 1 : 0;
+}
@@ -0,0 +1,404 @@
+﻿#include "pch.h"
+
+#include "check.h"
+#include "memory/function_hook.h"
+#include "memory/hook_dispatcher.h"
+#include "memory/hook_manager.h"
+#include "memory/virtual_memory.h"
+
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+// HookManager on the inline backend against real functions: install, toggle, batches, CALL_ORIGINAL and
+// closure detours, then the latency of installing and toggling hooks and the cost of a hooked call.
+
+#define NOINLINE __attribute__((noinline))
+
+namespace
+{
+    // Every target starts with a volatile load, so its first instruction is long enough for the jump and
+    // the compiler can't fold calls to it
+    volatile int g_calls = 0;
+
+    NOINLINE int multiply(int a, int b)
+    {
+        g_calls = g_calls + 1;
+        return a * b;
+    }
+
+    NOINLINE int add(int a, int b)
+    {
+        g_calls = g_calls + 1;
+        return a + b;
+    }
+
+    NOINLINE int subtract(int a, int b)
+    {
+        g_calls = g_calls + 1;
+        return a - b;
+    }
+
+    NOINLINE int scale(int a, int b)
+    {
+        g_calls = g_calls + 1;
+        return a * b * 2;
+    }
+
+    NOINLINE int dispatched(int a, int b)
+    {
+        g_calls = g_calls + 1;
+        return a - b;
+    }
+
+    NOINLINE int benchTarget(int a, int b)
+    {
+        g_calls = g_calls + 1;
+        return a ^ b;
+    }
+
+    NOINLINE int multiplyDetour(int a, int b)
+    {
+        return CALL_ORIGINAL(multiplyDetour, a, b) + 1;
+    }
+
+    NOINLINE int addDetour(int a, int b)
+    {
+        return CALL_ORIGINAL(addDetour, a, b) + 100;
+    }
+
+    NOINLINE int subtractDetour(int a, int b)
+    {
+        return CALL_ORIGINAL(subtractDetour, a, b) - 100;
+    }
+
+    NOINLINE int shortDetour(int a)
+    {
+        return CALL_ORIGINAL(shortDetour, a) + 1;
+    }
+
+    NOINLINE int benchDetour(int a, int b)
+    {
+        return CALL_ORIGINAL(benchDetour, a, b);
+    }
+
+    // Called through a volatile pointer, the hooked code is the one that runs
+    template <typename T>
+    T opaque(T function)
+    {
+        volatile T pointer = function;
+        return pointer;
+    }
+
+    using Clock = std::chrono::steady_clock;
+
+    double elapsedNs(Clock::time_point start, size_t iterations)
+    {
+        return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / static_cast<double>(iterations);
+    }
+
+    void testInstallAndToggle()
+    {
+        auto& manager = HookManager::getInstance();
+        const auto target = opaque(&multiply);
+
+        CHECK(HookManager::install(&multiply, &multiplyDetour));
+        CHECK(target(3, 4) == 13);
+        CHECK(manager.isEnabled(reinterpret_cast<void*>(&multiply)));
+
+        CHECK(manager.disableHook(reinterpret_cast<void*>(&multiply)));
+        CHECK(target(3, 4) == 12);
+        CHECK(!manager.isEnabled(reinterpret_cast<void*>(&multiply)));
+
+        CHECK(manager.enableHook(reinterpret_cast<void*>(&multiply)));
+        CHECK(target(3, 4) == 13);
+
+        CHECK(HookManager::uninstall(reinterpret_cast<void*>(&multiply)));
+        CHECK(target(3, 4) == 12);
+        CHECK(!manager.findHook(reinterpret_cast<void*>(&multiply)));
+    }
+
+    void testBatch()
+    {
+        auto& manager = HookManager::getInstance();
+        const auto addTarget = opaque(&add);
+        const auto subtractTarget = opaque(&subtract);
+
+        CHECK(HookManager::beginBatch());
+        CHECK(HookManager::install(&add, &addDetour));
+        CHECK(HookManager::install<subtractDetour>(&subtract));
+
+        // Queued only, nothing is patched before the commit
+        CHECK(addTarget(1, 2) == 3);
+        CHECK(HookManager::commitBatch());
+        CHECK(addTarget(1, 2) == 103);
+        CHECK(subtractTarget(5, 2) == -97);
+        std::printf("batch of 2 hooks applied in %.3f ms\n", manager.getLastBatchFreezeMs());
+
+        // A failing entry rolls the whole batch back
+        CHECK(HookManager::beginBatch());
+        CHECK(manager.disableHook(reinterpret_cast<void*>(&add)));
+        CHECK(!HookManager::install<int (*)(int, int)>(nullptr, &multiplyDetour));
+        CHECK(!HookManager::commitBatch());
+        CHECK(addTarget(1, 2) == 103);
+        CHECK(manager.isEnabled(reinterpret_cast<void*>(&add)));
+
+        CHECK(HookManager::uninstall(reinterpret_cast<void*>(&add)));
+        CHECK(HookManager::uninstall(reinterpret_cast<void*>(&subtract)));
+        CHECK(addTarget(1, 2) == 3);
+        CHECK(subtractTarget(5, 2) == 3);
+    }
+
+    // Another thread's toggle waits for the open batch instead of being queued into it
+    void testBatchOwnership()
+    {
+        auto& manager = HookManager::getInstance();
+        const auto target = opaque(&add);
+
+        CHECK(HookManager::install(&add, &addDetour));
+        CHECK(HookManager::beginBatch());
+        CHECK(manager.inBatch());
+
+        std::atomic<bool> disabled = false;
+        std::thread other([&]
+        {
+            CHECK(!manager.inBatch());
+            CHECK(!HookManager::commitBatch());
+            disabled = manager.disableHook(reinterpret_cast<void*>(&add));
+        });
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        CHECK(!disabled);
+        CHECK(target(1, 2) == 103);
+
+        CHECK(HookManager::commitBatch());
+        other.join();
+        CHECK(disabled);
+        CHECK(target(1, 2) == 3);
+
+        CHECK(HookManager::uninstall(reinterpret_cast<void*>(&add)));
+    }
+
+    // How FeatureBase toggles the hooks it owns: its own batch, or the one this thread already has open
+    void testScopedBatch()
+    {
+        auto& manager = HookManager::getInstance();
+        const auto addTarget = opaque(&add);
+        const auto subtractTarget = opaque(&subtract);
+
+        CHECK(HookManager::install(&add, &addDetour));
+        CHECK(HookManager::install<subtractDetour>(&subtract));
+
+        {
+            HookManager::ScopedBatch batch;
+            CHECK(manager.inBatch());
+            CHECK(manager.disableHook(reinterpret_cast<void*>(&add)));
+            CHECK(manager.disableHook(reinterpret_cast<void*>(&subtract)));
+            CHECK(addTarget(1, 2) == 103);
+            CHECK(batch.commit());
+        }
+        CHECK(!manager.inBatch());
+        CHECK(addTarget(1, 2) == 3);
+        CHECK(subtractTarget(5, 2) == 3);
+
+        CHECK(HookManager::beginBatch());
+        {
+            HookManager::ScopedBatch joined;
+            CHECK(manager.enableHook(reinterpret_cast<void*>(&add)));
+            CHECK(joined.commit());
+        }
+        {
+            HookManager::ScopedBatch joined;
+            CHECK(manager.enableHook(reinterpret_cast<void*>(&subtract)));
+        }
+
+        // Still queued in the outer batch
+        CHECK(manager.inBatch());
+        CHECK(addTarget(1, 2) == 3);
+        CHECK(HookManager::commitBatch());
+        CHECK(addTarget(1, 2) == 103);
+        CHECK(subtractTarget(5, 2) == -97);
+
+        CHECK(HookManager::uninstall(reinterpret_cast<void*>(&add)));
+        CHECK(HookManager::uninstall(reinterpret_cast<void*>(&subtract)));
+    }
+
+    void testClosureHook()
+    {
+        const auto target = opaque(&scale);
+        int offset = 7;
+
+        FunctionHook<int(int, int)> hook(&scale);
+        CHECK(hook.set([&hook, &offset](int a, int b) { return hook.call(a, b) + offset; }));
+        CHECK(target(2, 3) == 19);
+
+        offset = 1;
+        CHECK(target(2, 3) == 13);
+
+        hook.disable();
+        CHECK(target(2, 3) == 12);
+        hook.enable();
+        CHECK(target(2, 3) == 13);
+
+        hook.remove();
+        CHECK(target(2, 3) == 12);
+    }
+
+    // A rolled back batch releases the closure, and a hook going out of scope removes itself
+    void testClosureHookLifetime()
+    {
+        const auto target = opaque(&scale);
+        const auto state = std::make_shared<int>(5);
+
+        {
+            FunctionHook<int(int, int)> hook(&scale);
+            CHECK(HookManager::beginBatch());
+            CHECK(hook.set([state](int a, int b) { return a + b + *state; }));
+            CHECK(state.use_count() == 2);
+            CHECK(!HookManager::install<int (*)(int, int)>(nullptr, &multiplyDetour));
+            CHECK(!HookManager::commitBatch());
+            CHECK(!hook.isActive());
+            CHECK(state.use_count() == 1);
+
+            CHECK(hook.set([state](int a, int b) { return a + b + *state; }));
+            CHECK(target(2, 3) == 10);
+        }
+
+        CHECK(target(2, 3) == 12);
+        CHECK(state.use_count() == 1);
+        CHECK(!HookManager::getInstance().findHook(reinterpret_cast<void*>(&scale)));
+    }
+
+    // A hook gone before its batch is cancelled must not be touched by the batch's rollback
+    void testHookDestroyedInBatch()
+    {
+        const auto target = opaque(&scale);
+        const auto state = std::make_shared<int>(5);
+
+        CHECK(HookManager::beginBatch());
+        {
+            FunctionHook<int(int, int)> hook(&scale);
+            CHECK(hook.set([state](int a, int b) { return a + b + *state; }));
+        }
+        CHECK(state.use_count() == 1);
+
+        HookManager::cancelBatch();
+        CHECK(target(2, 3) == 12);
+        CHECK(!HookManager::getInstance().findHook(reinterpret_cast<void*>(&scale)));
+    }
+
+    // Functions shorter than the hook jump: only padding after the ret may be overwritten
+    void testShortFunction()
+    {
+        const auto page = static_cast<uint8_t*>(VirtualMemory::allocate(VirtualMemory::pageSize()));
+        CHECK(page);
+        if (!page) return;
+
+        // mov eax, edi; ret, then int3 padding up to the next function
+        constexpr uint8_t padded[] = {0x89, 0xF8, 0xC3, 0xCC, 0xCC, 0xCC, 0xCC, 0xCC, 0xCC, 0xCC, 0xCC, 0xCC, 0xCC,
+                                      0xCC, 0xCC, 0xCC};
+        memcpy(page, padded, sizeof(padded));
+        const auto identity = opaque(reinterpret_cast<int (*)(int)>(page));
+
+        CHECK(HookManager::install(identity, &shortDetour));
+        CHECK(identity(41) == 42);
+        CHECK(HookManager::uninstall(page));
+        CHECK(identity(41) == 41);
+
+        // Followed directly by another function's push rbp; mov rbp, rsp
+        constexpr uint8_t adjacent[] = {0x89, 0xF8, 0xC3, 0x55, 0x48, 0x89, 0xE5, 0xCC, 0xCC, 0xCC, 0xCC, 0xCC, 0xCC,
+                                        0xCC, 0xCC, 0xCC};
+        memcpy(page + 64, adjacent, sizeof(adjacent));
+        CHECK(!HookManager::install(reinterpret_cast<int (*)(int)>(page + 64), &shortDetour));
+        CHECK(memcmp(page + 64, adjacent, sizeof(adjacent)) == 0);
+
+        VirtualMemory::release(page, VirtualMemory::pageSize());
+    }
+
+    void testDispatcher()
+    {
+        using Dispatcher = HookDispatcher<int(int, int)>;
+        const auto target = opaque(&dispatched);
+
+        auto& dispatcher = Dispatcher::get(&dispatched);
+        const auto pre = dispatcher.addPre([](Dispatcher::Context&, int& a, int&) { a *= 10; });
+        const auto post = dispatcher.addPost([](Dispatcher::Context& context, int&, int&)
+        {
+            context.setReturnValue(*context.returnValue() + 1);
+        });
+        CHECK(pre && post);
+        CHECK(target(5, 2) == 49);
+
+        CHECK(dispatcher.remove(pre));
+        CHECK(target(5, 2) == 4);
+
+        // Nothing is published for a target that can't be hooked
+        auto& broken = Dispatcher::get(nullptr);
+        CHECK(broken.addPre([](Dispatcher::Context&, int&, int&) {}) == 0);
+        CHECK(broken.listenerCount() == 0);
+    }
+
+    void benchmark()
+    {
+        auto& manager = HookManager::getInstance();
+        const auto target = opaque(&benchTarget);
+        const auto hookTarget = reinterpret_cast<void*>(&benchTarget);
+
+        constexpr size_t INSTALLS = 1000;
+        auto start = Clock::now();
+        for (size_t i = 0; i < INSTALLS; ++i)
+        {
+            HookManager::install(&benchTarget, &benchDetour);
+            HookManager::uninstall(hookTarget);
+        }
+        std::printf("install + uninstall: %8.2f us\n", elapsedNs(start, INSTALLS) / 1000.0);
+
+        CHECK(HookManager::install(&benchTarget, &benchDetour));
+
+        constexpr size_t TOGGLES = 1000;
+        start = Clock::now();
+        for (size_t i = 0; i < TOGGLES; ++i)
+        {
+            manager.disableHook(hookTarget);
+            manager.enableHook(hookTarget);
+        }
+        std::printf("disable + enable:    %8.2f us\n", elapsedNs(start, TOGGLES) / 1000.0);
+
+        constexpr size_t CALLS = 10'000'000;
+        int sink = 0;
+
+        start = Clock::now();
+        for (size_t i = 0; i < CALLS; ++i) sink += target(static_cast<int>(i), 3);
+        const auto hooked = elapsedNs(start, CALLS);
+
+        manager.disableHook(hookTarget);
+        start = Clock::now();
+        for (size_t i = 0; i < CALLS; ++i) sink += target(static_cast<int>(i), 3);
+        const auto direct = elapsedNs(start, CALLS);
+
+        std::printf("direct call:         %8.2f ns\n", direct);
+        std::printf("detour + original:   %8.2f ns (%+.2f ns)\n", hooked, hooked - direct);
+
+        CHECK(HookManager::uninstall(hookTarget));
+        CHECK(sink != 0 || g_calls != 0);
+    }
+}
+
+int main()
+{
+    testInstallAndToggle();
+    testBatch();
+    testBatchOwnership();
+    testScopedBatch();
+    testClosureHook();
+    testClosureHookLifetime();
+    testHookDestroyedInBatch();
+    testShortFunction();
+    testDispatcher();
+    benchmark();
+
+    std::printf("hook backend: %s\n", HookManager::getInstance().getBackendName());
+    HookManager::getInstance().shutdown();
+
+    return testResult();
+}
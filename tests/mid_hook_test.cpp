@@ -0,0 +1,137 @@
+#include "pch.h"
+
+#include "check.h"
+#include "memory/mid_hook.h"
+#include "memory/virtual_memory.h"
+
+#include <cstdio>
+
+// MidHook on hand-written code in a private page: register writes from the callback, a displaced RIP-relative
+// load, and remove() putting the site back.
+
+namespace
+{
+    uint8_t* g_page = nullptr;
+
+    // float scaledSum(float a, float b, int scale), (a + b) * scale
+    constexpr size_t SCALED_SUM = 0x00;
+    constexpr size_t SCALED_SUM_SITE = SCALED_SUM + 4; // the addss, past the leading nop
+    constexpr uint8_t SCALED_SUM_CODE[] = {
+        0x0F, 0x1F, 0x40, 0x00, // nop dword [rax]
+        0xF3, 0x0F, 0x58, 0xC1, // addss xmm0, xmm1
+        0xF3, 0x0F, 0x2A, 0xCF, // cvtsi2ss xmm1, edi
+        0xF3, 0x0F, 0x59, 0xC1, // mulss xmm0, xmm1
+        0xC3,                   // ret
+    };
+
+    // int addGlobal(int a), a + the int at GLOBAL
+    constexpr size_t ADD_GLOBAL = 0x40;
+    constexpr size_t GLOBAL = 0x100;
+    constexpr int32_t GLOBAL_DISPLACEMENT = GLOBAL - (ADD_GLOBAL + 6);
+    constexpr uint8_t ADD_GLOBAL_CODE[] = {
+        0x8B, 0x05, GLOBAL_DISPLACEMENT & 0xFF, 0x00, 0x00, 0x00, // mov eax, [rip+GLOBAL]
+        0x01, 0xF8,                                               // add eax, edi
+        0xC3,                                                     // ret
+    };
+
+    // Called through a volatile pointer, the compiler can't assume anything about the page
+    template <typename T>
+    T at(size_t offset)
+    {
+        volatile T pointer = reinterpret_cast<T>(g_page + offset);
+        return pointer;
+    }
+
+    int32_t& global()
+    {
+        return *reinterpret_cast<int32_t*>(g_page + GLOBAL);
+    }
+
+    void write()
+    {
+        memset(g_page, 0xCC, VirtualMemory::pageSize());
+        memcpy(g_page + SCALED_SUM, SCALED_SUM_CODE, sizeof(SCALED_SUM_CODE));
+        memcpy(g_page + ADD_GLOBAL, ADD_GLOBAL_CODE, sizeof(ADD_GLOBAL_CODE));
+        global() = 1000;
+    }
+
+    void testRegisters()
+    {
+        const auto scaledSum = at<float (*)(float, float, int)>(SCALED_SUM);
+        CHECK(scaledSum(1.0f, 2.0f, 2) == 6.0f);
+
+        int calls = 0;
+        MidHook hook;
+        CHECK(hook.install(reinterpret_cast<uintptr_t>(g_page + SCALED_SUM_SITE), [&calls](MidHookContext& context)
+        {
+            // Arguments as they are at the addss, then b and scale replaced
+            if (context.xmm[0].f32[0] == 1.0f && context.xmm[1].f32[0] == 2.0f && context.rdi == 2) ++calls;
+            context.xmm[1].f32[0] = 10.0f;
+            context.rdi = 3;
+        }));
+        CHECK(hook.displacedLength() == 8);
+
+        CHECK(scaledSum(1.0f, 2.0f, 2) == 33.0f);
+        CHECK(calls == 1);
+    }
+
+    void testRipRelativeLoad()
+    {
+        const auto addGlobal = at<int (*)(int)>(ADD_GLOBAL);
+        CHECK(addGlobal(5) == 1005);
+
+        MidHook hook;
+        CHECK(hook.install(reinterpret_cast<uintptr_t>(g_page + ADD_GLOBAL), [](MidHookContext& context)
+        {
+            context.rdi *= 2;
+        }));
+        CHECK(hook.displacedLength() == 6);
+
+        // The relocated load still reads the original location, not a copy taken at install time
+        CHECK(addGlobal(5) == 1010);
+        global() = 2000;
+        CHECK(addGlobal(5) == 2010);
+    }
+
+    void testRemove()
+    {
+        uint8_t original[sizeof(SCALED_SUM_CODE)];
+        memcpy(original, g_page + SCALED_SUM, sizeof(original));
+        const auto scaledSum = at<float (*)(float, float, int)>(SCALED_SUM);
+
+        int calls = 0;
+        MidHook hook;
+        CHECK(hook.install(reinterpret_cast<uintptr_t>(g_page + SCALED_SUM_SITE),
+                           [&calls](MidHookContext&) { ++calls; }));
+        CHECK(memcmp(original, g_page + SCALED_SUM, sizeof(original)) != 0);
+        CHECK(scaledSum(1.0f, 2.0f, 2) == 6.0f && calls == 1);
+
+        hook.remove();
+        CHECK(!hook.isInstalled());
+        CHECK(memcmp(original, g_page + SCALED_SUM, sizeof(original)) == 0);
+        CHECK(scaledSum(1.0f, 2.0f, 2) == 6.0f && calls == 1);
+
+        // The site can be hooked again
+        CHECK(hook.install(reinterpret_cast<uintptr_t>(g_page + SCALED_SUM_SITE),
+                           [&calls](MidHookContext&) { ++calls; }));
+        CHECK(scaledSum(1.0f, 2.0f, 2) == 6.0f && calls == 2);
+    }
+}
+
+int main()
+{
+    g_page = static_cast<uint8_t*>(VirtualMemory::allocate(VirtualMemory::pageSize()));
+    CHECK(g_page);
+    if (!g_page) return 1;
+
+    write();
+    testRegisters();
+    write();
+    testRipRelativeLoad();
+    write();
+    testRemove();
+
+    VirtualMemory::release(g_page, VirtualMemory::pageSize());
+
+    return testResult();
+}
@@ -0,0 +1,110 @@
+#include "pch.h"
+
+#include "check.h"
+#include "memory/mem.h"
+#include "memory/patch_set.h"
+#include "memory/virtual_memory.h"
+
+#include <cstdio>
+
+// PatchSet commit and rollback on a private page, and how overlapping sets share Mem's bookkeeping.
+
+namespace
+{
+    uint8_t* g_page = nullptr;
+
+    void reset()
+    {
+        for (size_t i = 0; i < 64; ++i) g_page[i] = static_cast<uint8_t>(i);
+    }
+
+    uintptr_t at(size_t offset)
+    {
+        return reinterpret_cast<uintptr_t>(g_page + offset);
+    }
+
+    bool unpatched(size_t begin, size_t end)
+    {
+        for (auto i = begin; i < end; ++i)
+        {
+            if (g_page[i] != i) return false;
+        }
+        return true;
+    }
+
+    void testCommitAndRollback()
+    {
+        reset();
+
+        PatchSet set;
+        set.nop(at(4), 4).patch(at(16), {0xB0, 0x01, 0xC3});
+        CHECK(set.commit());
+        CHECK(g_page[4] == 0x90 && g_page[7] == 0x90 && g_page[16] == 0xB0);
+        CHECK(Mem::findPatch(at(17)));
+
+        CHECK(set.rollback());
+        CHECK(unpatched(0, 64));
+        CHECK(!Mem::findPatch(at(4)) && !Mem::findPatch(at(16)));
+    }
+
+    void testOverlappingSets()
+    {
+        reset();
+
+        PatchSet first;
+        first.nop(at(8), 8);
+        CHECK(first.commit());
+
+        PatchSet second;
+        second.patch(at(12), {0xCC, 0xCC, 0xCC, 0xCC, 0xCC, 0xCC, 0xCC, 0xCC});
+        CHECK(second.commit());
+
+        // Rolling the first set back would restore bytes the second one still covers
+        CHECK(!first.rollback());
+        CHECK(g_page[8] == 0x90 && g_page[12] == 0xCC);
+
+        // Newest first keeps the record the first set merged into
+        CHECK(second.rollback());
+        CHECK(g_page[12] == 0x90 && g_page[16] == 16);
+        CHECK(Mem::findPatch(at(8)));
+
+        CHECK(first.rollback());
+        CHECK(unpatched(0, 64));
+        CHECK(!Mem::findPatch(at(8)));
+    }
+
+    void testMergedIntoOlderPatch()
+    {
+        reset();
+
+        PatchSet older;
+        older.nop(at(0), 32);
+        CHECK(older.commit());
+
+        // Both entries of the newer set merge into the older patch
+        PatchSet newer;
+        newer.patch(at(2), {0xAA}).patch(at(20), {0xBB});
+        CHECK(newer.commit());
+        CHECK(newer.rollback());
+        CHECK(g_page[2] == 0x90 && g_page[20] == 0x90);
+        CHECK(Mem::findPatch(at(0)));
+
+        CHECK(older.rollback());
+        CHECK(unpatched(0, 64));
+    }
+}
+
+int main()
+{
+    g_page = static_cast<uint8_t*>(VirtualMemory::allocate(VirtualMemory::pageSize()));
+    CHECK(g_page);
+    if (!g_page) return 1;
+
+    testCommitAndRollback();
+    testOverlappingSets();
+    testMergedIntoOlderPatch();
+
+    VirtualMemory::release(g_page, VirtualMemory::pageSize());
+
+    return testResult();
+}
@@ -0,0 +1,122 @@
+#include "pch.h"
+
+#include "check.h"
+#include "memory/pe_file.h"
+
+#include <cstdio>
+#include <fstream>
+
+// PeFile::open on crafted images: a well-formed one, and headers that would make PeImage read past the
+// sizeOfImage buffer PeFile lays the image out in.
+
+namespace
+{
+    constexpr uint32_t LFANEW = 0x40;
+    constexpr uint32_t SECTION_TABLE = LFANEW + sizeof(pe::NtHeaders64);
+
+    // One .text section at RVA 0x1000 with 0x200 bytes of raw data at file offset 0x200
+    std::vector<uint8_t> makeImage()
+    {
+        std::vector<uint8_t> file(0x400, 0);
+
+        pe::DosHeader dos{};
+        dos.magic = pe::DOS_MAGIC;
+        dos.lfanew = LFANEW;
+        memcpy(file.data(), &dos, sizeof(dos));
+
+        pe::NtHeaders64 nt{};
+        nt.signature = pe::NT_SIGNATURE;
+        nt.fileHeader.numberOfSections = 1;
+        nt.fileHeader.sizeOfOptionalHeader = sizeof(pe::OptionalHeader64);
+        nt.optionalHeader.magic = pe::OPTIONAL_MAGIC_64;
+        nt.optionalHeader.sizeOfImage = 0x2000;
+        nt.optionalHeader.sizeOfHeaders = 0x200;
+        nt.optionalHeader.numberOfRvaAndSizes = 16;
+        nt.optionalHeader.dataDirectory[pe::DIRECTORY_EXCEPTION] = {0x1100, 0x0C};
+        memcpy(file.data() + LFANEW, &nt, sizeof(nt));
+
+        pe::SectionHeader text{};
+        memcpy(text.name, ".text", 5);
+        text.virtualSize = 0x200;
+        text.virtualAddress = 0x1000;
+        text.sizeOfRawData = 0x200;
+        text.pointerToRawData = 0x200;
+        text.characteristics = pe::SCN_CNT_CODE | pe::SCN_MEM_EXECUTE | pe::SCN_MEM_READ;
+        memcpy(file.data() + SECTION_TABLE, &text, sizeof(text));
+
+        file[0x200] = 0xC3;
+        return file;
+    }
+
+    pe::NtHeaders64& ntHeaders(std::vector<uint8_t>& file)
+    {
+        return *reinterpret_cast<pe::NtHeaders64*>(file.data() + LFANEW);
+    }
+
+    std::unique_ptr<PeFile> load(const std::vector<uint8_t>& file)
+    {
+        const auto path = std::filesystem::temp_directory_path() / "pe_file_test.bin";
+        std::ofstream(path, std::ios::binary).write(reinterpret_cast<const char*>(file.data()),
+                                                    static_cast<std::streamsize>(file.size()));
+        auto result = PeFile::open(path);
+        std::filesystem::remove(path);
+        return result;
+    }
+
+    void testValidImage()
+    {
+        const auto file = load(makeImage());
+        CHECK(file);
+        if (!file) return;
+
+        CHECK(file->size() == 0x2000);
+        CHECK(file->image().sections().size() == 1);
+        CHECK(file->image().findSection(".text"));
+        CHECK(*reinterpret_cast<const uint8_t*>(file->rvaToAddress(0x1000)) == 0xC3);
+        CHECK(file->image().directory(pe::DIRECTORY_EXCEPTION).virtualAddress == 0x1100);
+        CHECK(file->image().directory(16).virtualAddress == 0);
+    }
+
+    void testHeadersPastSizeOfImage()
+    {
+        // NT headers and section table would end past a 0x100 byte image
+        auto image = makeImage();
+        ntHeaders(image).fileHeader.sizeOfOptionalHeader = 0;
+        ntHeaders(image).optionalHeader.sizeOfImage = 0x100;
+        ntHeaders(image).optionalHeader.sizeOfHeaders = 0x100;
+        CHECK(!load(image));
+
+        // Section table past sizeOfHeaders
+        image = makeImage();
+        ntHeaders(image).fileHeader.numberOfSections = 40;
+        CHECK(!load(image));
+
+        // NT headers past sizeOfHeaders
+        image = makeImage();
+        ntHeaders(image).optionalHeader.sizeOfHeaders = LFANEW + 0x20;
+        CHECK(!load(image));
+    }
+
+    void testDirectoriesOutsideImage()
+    {
+        auto image = makeImage();
+        ntHeaders(image).optionalHeader.dataDirectory[pe::DIRECTORY_EXCEPTION] = {0x1F00, 0x200};
+        auto file = load(image);
+        CHECK(file && file->image().directory(pe::DIRECTORY_EXCEPTION).size == 0);
+
+        // More directories claimed than the optional header holds
+        image = makeImage();
+        ntHeaders(image).optionalHeader.numberOfRvaAndSizes = 64;
+        file = load(image);
+        CHECK(file && file->image().directory(20).size == 0);
+    }
+}
+
+int main()
+{
+    testValidImage();
+    testHeadersPastSizeOfImage();
+    testDirectoriesOutsideImage();
+
+    return testResult();
+}
@@ -0,0 +1,97 @@
+#include "pch.h"
+
+#include "check.h"
+#include "utils/rcu_snapshot.h"
+
+#include <cstdio>
+#include <thread>
+
+// RcuSnapshot reclamation: replaced snapshots are freed once the read sections that could see them have
+// ended, also while some reader is always active.
+
+namespace
+{
+    void testNoReaders()
+    {
+        RcuSnapshot<int> snapshot;
+        for (int i = 1; i <= 100; ++i) snapshot.update([i](int& value) { value = i; });
+
+        CHECK(*snapshot.read() == 100);
+        CHECK(snapshot.retiredCount() <= 2);
+    }
+
+    void testPinnedSnapshot()
+    {
+        RcuSnapshot<int> snapshot;
+        snapshot.update([](int& value) { value = 1; });
+
+        const auto guard = snapshot.read();
+        for (int i = 2; i <= 10; ++i) snapshot.update([i](int& value) { value = i; });
+
+        // The guard keeps its snapshot, and everything replaced after it
+        CHECK(*guard == 1);
+        CHECK(*snapshot.read() == 10);
+    }
+
+    // Read sections overlap, so the reader count never drops to zero
+    void testOverlappingReaders()
+    {
+        RcuSnapshot<int> snapshot;
+        std::optional<RcuSnapshot<int>::ReadGuard> guards[2];
+
+        size_t maxRetired = 0;
+        for (int i = 1; i <= 1000; ++i)
+        {
+            guards[i % 2].reset();
+            guards[i % 2].emplace(snapshot);
+            snapshot.update([i](int& value) { value = i; });
+            maxRetired = (std::max)(maxRetired, snapshot.retiredCount());
+        }
+
+        CHECK(maxRetired <= 3);
+        CHECK(*snapshot.read() == 1000);
+    }
+
+    void testConcurrentReaders()
+    {
+        RcuSnapshot<std::vector<int>> snapshot;
+        std::atomic<bool> stop = false;
+        std::atomic<size_t> torn = 0;
+
+        std::vector<std::thread> readers;
+        for (int i = 0; i < 4; ++i)
+        {
+            readers.emplace_back([&]
+            {
+                while (!stop)
+                {
+                    const auto values = snapshot.read();
+                    for (const auto value : *values)
+                    {
+                        if (value != static_cast<int>(values->size())) ++torn;
+                    }
+                }
+            });
+        }
+
+        for (int i = 1; i <= 2000; ++i)
+            snapshot.update([i](std::vector<int>& values) { values.assign(static_cast<size_t>(i % 64), i % 64); });
+
+        stop = true;
+        for (auto& reader : readers) reader.join();
+
+        CHECK(torn == 0);
+        snapshot.update([](std::vector<int>& values) { values.clear(); });
+        CHECK(snapshot.retiredCount() <= 2);
+    }
+}
+
+int main()
+{
+    testNoReaders();
+    testPinnedSnapshot();
+    testOverlappingReaders();
+    testConcurrentReaders();
+
+    return testResult();
+}